@@ -0,0 +1,512 @@
+/*
+ * GStreamer
+ * Copyright (C) 2009 Sebastian <sebp@k-d-w.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Throughput benchmark for teletextdec.
+ *
+ * Feeds a recorded teletext PES stream through
+ *   appsrc ! teletextdec ! fakesink
+ * as fast as possible, either as PES packets (video/mpeg) or as their
+ * payloads (private/teletext), and reports packets/s, pages/s, the CPU time
+ * needed per hour of stream and the peak RSS of the process.
+ *
+ * With --density N it instead runs 1, 2, 4... up to N decoders in the same
+ * process, fed packet by packet in turn, and prints one row per instance
+ * count with the CPU time per hour of stream, the RSS and the page cache
+ * memory reported by the decoders, as columns for gnuplot or a spreadsheet.
+ */
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define PES_CAPS "video/mpeg,mpegversion=2,systemstream=TRUE"
+#define TELX_CAPS "private/teletext"
+
+typedef struct
+{
+  const gchar *name;
+  const gchar *caps;
+  gboolean subtitles_mode;
+} OutputFormat;
+
+static const OutputFormat formats[] = {
+  {"rgba", "video/x-raw-rgb", FALSE},
+  {"text", "text/plain", FALSE},
+  {"html", "text/html", FALSE},
+  {"subtitles", "text/plain", TRUE},
+};
+
+typedef struct
+{
+  guint8 *data;
+  guint size;
+  guint payload;                /* offset of the PES payload */
+  GstClockTime pts;
+} Packet;
+
+static gchar *mode = "pes";
+static gchar *format_name = NULL;
+static gint pageno = 100;
+static gint repeat = 1;
+static gchar *renderer = "zvbi";
+static gint density = 0;
+static gint max_cache_pages = 0;
+static gchar *cache_page_set = NULL;
+
+static GOptionEntry entries[] = {
+  {"mode", 'm', 0, G_OPTION_ARG_STRING, &mode,
+      "Input caps: pes or telx (default: pes)", "MODE"},
+  {"format", 'f', 0, G_OPTION_ARG_STRING, &format_name,
+      "Output format: rgba, text, html or subtitles (default: all)", "FORMAT"},
+  {"page", 'p', 0, G_OPTION_ARG_INT, &pageno,
+      "Page to decode (default: 100)", "PAGE"},
+  {"repeat", 'n', 0, G_OPTION_ARG_INT, &repeat,
+      "Feed the capture N times (default: 1)", "N"},
+  {"renderer", 'r', 0, G_OPTION_ARG_STRING, &renderer,
+      "RGBA renderer: zvbi or glyph-cache (default: zvbi)", "RENDERER"},
+  {"density", 'd', 0, G_OPTION_ARG_INT, &density,
+      "Run up to N decoders at once and report the cost per decoder", "N"},
+  {"max-cache-pages", 'c', 0, G_OPTION_ARG_INT, &max_cache_pages,
+      "Pages each decoder caches besides the one shown (default: all)", "N"},
+  {"cache-page-set", 's', 0, G_OPTION_ARG_STRING, &cache_page_set,
+      "Pages each decoder caches, like 100-199,888 (default: all)", "SET"},
+  {NULL}
+};
+
+static volatile gint n_pages;
+
+/* Splits a PES stream into its packets */
+static GArray *
+split_pes (guint8 * data, gsize size)
+{
+  GArray *packets = g_array_new (FALSE, FALSE, sizeof (Packet));
+  gsize offset = 0;
+
+  while (offset + 9 <= size) {
+    Packet p;
+    guint8 *h = data + offset;
+
+    if (h[0] != 0 || h[1] != 0 || h[2] != 1 || h[3] != 0xBD) {
+      offset++;
+      continue;
+    }
+
+    p.data = h;
+    p.size = 6 + GST_READ_UINT16_BE (h + 4);
+    p.payload = 9 + h[8];
+    if (offset + p.size > size || p.payload >= p.size)
+      break;
+
+    p.pts = GST_CLOCK_TIME_NONE;
+    if ((h[7] & 0x80) && p.payload >= 14) {
+      guint64 pts;
+
+      pts = ((guint64) (h[9] & 0x0E) << 29) | (h[10] << 22) |
+          ((h[11] & 0xFE) << 14) | (h[12] << 7) | (h[13] >> 1);
+      p.pts = gst_util_uint64_scale (pts, GST_SECOND, 90000);
+    }
+
+    g_array_append_val (packets, p);
+    offset += p.size;
+  }
+
+  return packets;
+}
+
+static void
+on_handoff (GstElement * sink, GstBuffer * buf, GstPad * pad, gpointer data)
+{
+  g_atomic_int_inc (&n_pages);
+}
+
+static gdouble
+cpu_seconds (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static glong
+peak_rss_kb (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static glong
+rss_kb (void)
+{
+  gchar *statm;
+  glong size, resident = 0;
+
+  if (g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL)) {
+    if (sscanf (statm, "%ld %ld", &size, &resident) != 2)
+      resident = 0;
+    g_free (statm);
+  }
+
+  return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+/* Returns the time between the first and the last packet with a PTS, and
+ * their PTS in @first_pts and @last_pts. Both are 0 if no packet has one. */
+static GstClockTime
+pts_range (GArray * packets, GstClockTime * first_pts,
+    GstClockTime * last_pts)
+{
+  guint first, last;
+
+  for (first = 0; first < packets->len; first++) {
+    if (GST_CLOCK_TIME_IS_VALID (g_array_index (packets, Packet, first).pts))
+      break;
+  }
+  for (last = packets->len; last > first; last--) {
+    if (GST_CLOCK_TIME_IS_VALID (g_array_index (packets, Packet,
+                last - 1).pts))
+      break;
+  }
+
+  if (first == packets->len || last <= first) {
+    *first_pts = *last_pts = 0;
+    return 0;
+  }
+
+  *first_pts = g_array_index (packets, Packet, first).pts;
+  *last_pts = g_array_index (packets, Packet, last - 1).pts;
+  return *last_pts > *first_pts ? *last_pts - *first_pts : 0;
+}
+
+static GstElement *
+make_pipeline (const OutputFormat * format, GstElement ** src)
+{
+  GstElement *pipeline, *sink;
+  GError *error = NULL;
+  GString *desc;
+
+  desc = g_string_new (NULL);
+  g_string_printf (desc, "appsrc name=src block=true caps=\"%s\" ! "
+      "teletextdec name=dec page=%d subtitles-mode=%s renderer=%s "
+      "max-cache-pages=%d", g_strcmp0 (mode, "telx") ? PES_CAPS : TELX_CAPS,
+      pageno, format->subtitles_mode ? "true" : "false", renderer,
+      max_cache_pages);
+  if (cache_page_set != NULL)
+    g_string_append_printf (desc, " cache-page-set=\"%s\"", cache_page_set);
+  g_string_append_printf (desc, " ! %s ! "
+      "fakesink name=sink sync=false signal-handoffs=true", format->caps);
+
+  pipeline = gst_parse_launch (desc->str, &error);
+  g_string_free (desc, TRUE);
+  if (pipeline == NULL) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return NULL;
+  }
+
+  *src = gst_bin_get_by_name (GST_BIN (pipeline), "src");
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (on_handoff), NULL);
+  g_object_set (*src, "format", GST_FORMAT_TIME, NULL);
+  gst_object_unref (sink);
+
+  return pipeline;
+}
+
+/* Pushes the capture @repeat times into each of the @n_srcs sources, one
+ * packet to every source in turn, and returns the packets pushed per
+ * source */
+static guint
+feed (GstElement ** srcs, gint n_srcs, GArray * packets)
+{
+  gboolean telx = g_strcmp0 (mode, "telx") == 0;
+  GstClockTime first_pts, last_pts, stream_time, offset = 0;
+  guint i, n_packets = 0;
+  gint r, k;
+
+  stream_time = pts_range (packets, &first_pts, &last_pts);
+
+  for (r = 0; r < repeat; r++) {
+    for (i = 0; i < packets->len; i++) {
+      Packet *p = &g_array_index (packets, Packet, i);
+      GstFlowReturn ret = GST_FLOW_OK;
+
+      for (k = 0; k < n_srcs; k++) {
+        GstBuffer *buf;
+
+        buf = gst_buffer_new ();
+        if (telx) {
+          GST_BUFFER_DATA (buf) = p->data + p->payload;
+          GST_BUFFER_SIZE (buf) = p->size - p->payload;
+        } else {
+          GST_BUFFER_DATA (buf) = p->data;
+          GST_BUFFER_SIZE (buf) = p->size;
+        }
+        if (GST_CLOCK_TIME_IS_VALID (p->pts) && p->pts >= first_pts)
+          GST_BUFFER_TIMESTAMP (buf) = p->pts - first_pts + offset;
+
+        g_signal_emit_by_name (srcs[k], "push-buffer", buf, &ret);
+        gst_buffer_unref (buf);
+        if (ret != GST_FLOW_OK)
+          goto done;
+      }
+      n_packets++;
+    }
+    offset += stream_time + GST_SECOND / 25;
+  }
+
+done:
+  for (k = 0; k < n_srcs; k++)
+    g_signal_emit_by_name (srcs[k], "end-of-stream", NULL);
+
+  return n_packets;
+}
+
+/* Waits for @pipeline to finish, and returns the page cache memory of its
+ * decoder at the end of the stream */
+static guint64
+wait_eos (const gchar * capture, GstElement * pipeline)
+{
+  GstElement *dec;
+  GstBus *bus;
+  GstMessage *msg;
+  guint64 cache_memory;
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    GError *error;
+    gchar *debug;
+
+    gst_message_parse_error (msg, &error, &debug);
+    g_printerr ("%s: %s\n%s\n", capture, error->message, debug);
+    g_error_free (error);
+    g_free (debug);
+  }
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  dec = gst_bin_get_by_name (GST_BIN (pipeline), "dec");
+  g_object_get (dec, "cache-memory", &cache_memory, NULL);
+  gst_object_unref (dec);
+
+  return cache_memory;
+}
+
+static gdouble
+stream_seconds (GArray * packets)
+{
+  GstClockTime first_pts, last_pts, stream_time;
+
+  stream_time = pts_range (packets, &first_pts, &last_pts);
+  return (gdouble) (repeat * (stream_time + GST_SECOND / 25)) / GST_SECOND;
+}
+
+static gboolean
+run (const gchar * capture, GArray * packets, const OutputFormat * format)
+{
+  GstElement *pipeline, *src;
+  gchar *label;
+  GTimer *timer;
+  gdouble wall, cpu, stream_secs;
+  guint n_packets;
+
+  pipeline = make_pipeline (format, &src);
+  if (pipeline == NULL)
+    return FALSE;
+
+  n_pages = 0;
+  timer = g_timer_new ();
+  cpu = cpu_seconds ();
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  n_packets = feed (&src, 1, packets);
+  wait_eos (capture, pipeline);
+
+  wall = g_timer_elapsed (timer, NULL);
+  cpu = cpu_seconds () - cpu;
+  g_timer_destroy (timer);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (src);
+  gst_object_unref (pipeline);
+
+  stream_secs = stream_seconds (packets);
+
+  /* the renderer only matters for RGBA */
+  if (g_strcmp0 (format->name, "rgba") == 0)
+    label = g_strdup_printf ("rgba/%s", renderer);
+  else
+    label = g_strdup (format->name);
+
+  g_print ("%-24s %-5s %-16s %9u %7d %8.3f %11.0f %9.1f %8.3f %10.1f %9ld\n",
+      capture, mode, label, n_packets, n_pages, wall,
+      n_packets / wall, n_pages / wall, cpu,
+      stream_secs > 0 ? cpu / stream_secs * 3600 : 0.0, peak_rss_kb ());
+  g_free (label);
+
+  return TRUE;
+}
+
+/* Runs @n_instances pipelines at once over the capture */
+static gboolean
+run_density (const gchar * capture, GArray * packets,
+    const OutputFormat * format, gint n_instances)
+{
+  GstElement **pipelines, **srcs;
+  GTimer *timer;
+  gdouble wall, cpu, stream_secs;
+  guint64 cache_memory = 0;
+  glong rss, base_rss;
+  gint k;
+
+  pipelines = g_new0 (GstElement *, n_instances);
+  srcs = g_new0 (GstElement *, n_instances);
+
+  base_rss = rss_kb ();
+  for (k = 0; k < n_instances; k++) {
+    pipelines[k] = make_pipeline (format, &srcs[k]);
+    if (pipelines[k] == NULL)
+      goto error;
+  }
+
+  n_pages = 0;
+  timer = g_timer_new ();
+  cpu = cpu_seconds ();
+
+  for (k = 0; k < n_instances; k++)
+    gst_element_set_state (pipelines[k], GST_STATE_PLAYING);
+  feed (srcs, n_instances, packets);
+  for (k = 0; k < n_instances; k++)
+    cache_memory += wait_eos (capture, pipelines[k]);
+
+  wall = g_timer_elapsed (timer, NULL);
+  cpu = cpu_seconds () - cpu;
+  g_timer_destroy (timer);
+  /* measured while all the decoders still hold their caches */
+  rss = rss_kb ();
+
+  for (k = 0; k < n_instances; k++) {
+    gst_element_set_state (pipelines[k], GST_STATE_NULL);
+    gst_object_unref (srcs[k]);
+    gst_object_unref (pipelines[k]);
+  }
+  g_free (srcs);
+  g_free (pipelines);
+
+  stream_secs = stream_seconds (packets);
+
+  g_print ("%-9d %-16s %7d %8.3f %8.3f %10.1f %12.1f %9ld %12ld %12"
+      G_GUINT64_FORMAT "\n", n_instances, format->name, n_pages, wall, cpu,
+      stream_secs > 0 ? cpu / stream_secs * 3600 : 0.0,
+      stream_secs > 0 ? cpu / stream_secs * 3600 / n_instances : 0.0,
+      rss, (rss - base_rss) / n_instances, cache_memory / n_instances / 1024);
+
+  return TRUE;
+
+error:
+  for (k = 0; k < n_instances && pipelines[k] != NULL; k++) {
+    gst_object_unref (srcs[k]);
+    gst_object_unref (pipelines[k]);
+  }
+  g_free (srcs);
+  g_free (pipelines);
+  return FALSE;
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *ctx;
+  GError *error = NULL;
+  gint i, j;
+
+  ctx = g_option_context_new ("CAPTURE.pes... - teletextdec throughput");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (argc < 2) {
+    g_printerr ("No capture given\n");
+    return 1;
+  }
+
+  if (density > 0)
+    g_print ("%-9s %-16s %7s %8s %8s %10s %12s %9s %12s %12s\n",
+        "# decoders", "format", "pages", "wall-s", "cpu-s", "cpu-s/hour",
+        "cpu-s/h/dec", "rss-kB", "rss-kB/dec", "cache-kB/dec");
+  else
+    g_print ("%-24s %-5s %-16s %9s %7s %8s %11s %9s %8s %10s %9s\n",
+        "capture", "mode", "format", "packets", "pages", "wall-s",
+        "packets/s", "pages/s", "cpu-s", "cpu-s/hour", "rss-kB");
+
+  for (i = 1; i < argc; i++) {
+    gchar *contents;
+    gsize size;
+    GArray *packets;
+
+    if (!g_file_get_contents (argv[i], &contents, &size, &error)) {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      return 1;
+    }
+
+    packets = split_pes ((guint8 *) contents, size);
+    if (packets->len == 0) {
+      g_printerr ("%s: no teletext PES packets found\n", argv[i]);
+      return 1;
+    }
+
+    for (j = 0; j < G_N_ELEMENTS (formats); j++) {
+      gint n;
+
+      if (format_name != NULL && g_strcmp0 (format_name, formats[j].name))
+        continue;
+      if (density <= 0) {
+        if (!run (argv[i], packets, &formats[j]))
+          return 1;
+        continue;
+      }
+
+      for (n = 1; n < density * 2; n *= 2) {
+        if (!run_density (argv[i], packets, &formats[j], MIN (n, density)))
+          return 1;
+      }
+    }
+
+    g_array_free (packets, TRUE);
+    g_free (contents);
+  }
+
+  return 0;
+}
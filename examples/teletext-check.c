@@ -0,0 +1,718 @@
+/*
+ * GStreamer
+ * Copyright (C) 2009 Sebastian <sebp@k-d-w.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Checks of the teletext elements on generated streams.
+ *
+ * The streams are pushed from a pad of the program into the element, so
+ * everything runs on the calling thread and the outcome is known as soon
+ * as the push returns. Exits with a non-zero status if a check fails.
+ *
+ * GLib allocations are counted through a GMemVTable, which GLib before
+ * 2.46 supports, to check that the decode path does not allocate.
+ */
+
+#include <gst/gst.h>
+#include <libzvbi.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TS_PACKET_SIZE 188
+#define PMT_PID 0x100
+#define TELETEXT_PID 0x101
+
+#define DATA_UNIT_SIZE 46
+/* units in a PES packet filling two transport stream packets */
+#define UNITS_PER_PES 7
+
+/* frames decoded before and while counting allocations */
+#define WARMUP_FRAMES 50
+#define COUNTED_FRAMES 200
+
+static GstStaticPadTemplate text_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("text/plain"));
+
+static GstStaticPadTemplate rgba_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw-rgb, bpp=(int)32, depth=(int)32, "
+        "endianness=(int)4321, red_mask=(int)-16777216, "
+        "green_mask=(int)16711680, blue_mask=(int)65280, "
+        "alpha_mask=(int)255"));
+
+/* Rows of the page the renderers are compared on: flashing, concealed,
+ * boxed text and contiguous and separated mosaics, with the control
+ * characters of ETS 300 706 */
+static const gchar *const render_rows[] = {
+  "\x01Red \x08" "Flashing\x09 steady \x03Shown \x18" "Concealed",
+  "\x12\x21\x22\x23\x2C\x35\x3F\x60\x6A\x7F\x1A\x21\x2C\x35\x3F"
+      "\x6A\x7F\x19\x7F\x1E\x75\x1F\x7A",
+  "\x0B\x0B\x07" "Boxed subtitle\x0A\x0A outside",
+  "\x04\x1D\x07New background\x1C black \x0B\x0B\x06" "boxed\x0A\x0A",
+  "\x0B\x0B\x05\x08" "Boxed flash \x18" "concealed\x0A\x0A"
+};
+
+static gint n_failed;
+static gint n_buffers;
+static GstClockTime first_timestamp;
+static GstFormat segment_format;
+static GstPad *output_pad;
+static GstBuffer *last_frame;
+static volatile gint n_allocs;
+
+#define CHECK(expr, ...) G_STMT_START {                 \
+  if (!(expr)) {                                        \
+    g_printerr ("FAIL %s: ", G_STRFUNC);                \
+    g_printerr (__VA_ARGS__);                           \
+    g_printerr ("\n");                                  \
+    n_failed++;                                         \
+    return;                                             \
+  }                                                     \
+} G_STMT_END
+
+static gpointer
+counting_malloc (gsize n_bytes)
+{
+  g_atomic_int_inc (&n_allocs);
+  return malloc (n_bytes);
+}
+
+static gpointer
+counting_realloc (gpointer mem, gsize n_bytes)
+{
+  g_atomic_int_inc (&n_allocs);
+  return realloc (mem, n_bytes);
+}
+
+static gpointer
+counting_calloc (gsize n_blocks, gsize n_block_bytes)
+{
+  g_atomic_int_inc (&n_allocs);
+  return calloc (n_blocks, n_block_bytes);
+}
+
+static GMemVTable counting_vtable = {
+  counting_malloc, counting_realloc, free, counting_calloc, counting_malloc,
+  counting_realloc
+};
+
+/* Writes a teletext data unit for packet @packet of magazine @magazine.
+ * @data holds its 40 bytes as they are sent, before the bits are reversed
+ * for the DVB transmission order. */
+static void
+write_data_unit (guint8 * unit, guint line, guint magazine, guint packet,
+    const guint8 * data)
+{
+  guint8 mrag[2];
+  gint i;
+
+  mrag[0] = vbi_ham8 ((magazine & 7) | (packet & 1) << 3);
+  mrag[1] = vbi_ham8 (packet >> 1);
+
+  unit[0] = 0x02;
+  unit[1] = 0x2C;
+  unit[2] = 0xE0 | line;
+  unit[3] = 0xE4;
+  unit[4] = vbi_rev8 (mrag[0]);
+  unit[5] = vbi_rev8 (mrag[1]);
+  for (i = 0; i < 40; i++)
+    unit[6 + i] = vbi_rev8 (data[i]);
+}
+
+/* Writes the header of page @pgno, in serial mode so that the next header
+ * completes the page, and flagged as a subtitle page if @subtitle */
+static void
+write_header (guint8 * unit, guint line, vbi_pgno pgno, gboolean subtitle)
+{
+  guint8 data[40];
+  gint i;
+
+  data[0] = vbi_ham8 (pgno & 0xF);
+  data[1] = vbi_ham8 ((pgno >> 4) & 0xF);
+  data[2] = vbi_ham8 (0);
+  /* C4, erase page */
+  data[3] = vbi_ham8 (0x8);
+  data[4] = vbi_ham8 (0);
+  /* C6, subtitle */
+  data[5] = vbi_ham8 (subtitle ? 0x8 : 0);
+  data[6] = vbi_ham8 (0);
+  /* C11, serial mode */
+  data[7] = vbi_ham8 (0x1);
+  for (i = 8; i < 40; i++)
+    data[i] = vbi_par8 (" teletext-check  100 Jan 01 00:00"[i - 8]);
+
+  write_data_unit (unit, line, pgno >> 8, 0, data);
+}
+
+static void
+write_row (guint8 * unit, guint line, vbi_pgno pgno, guint row,
+    const gchar * text)
+{
+  guint8 data[40];
+  gint i, length = strlen (text);
+
+  for (i = 0; i < 40; i++)
+    data[i] = vbi_par8 (i < length ? text[i] : ' ');
+
+  write_data_unit (unit, line, pgno >> 8, row, data);
+}
+
+/* Returns a PES packet with the header of page @pgno, rows 1 to 5 from
+ * @rows and the header of page @pgno + 1, which ends the page */
+static guint8 *
+make_page_pes (vbi_pgno pgno, const gchar * const *rows, gboolean subtitle,
+    guint64 pts, guint * size)
+{
+  guint8 *pes, *unit;
+  guint i, payload;
+
+  /* PES header of 45 bytes as EN 300 472 wants it */
+  payload = 1 + UNITS_PER_PES * DATA_UNIT_SIZE;
+  *size = 45 + payload;
+  pes = g_malloc0 (*size);
+
+  pes[0] = 0x00;
+  pes[1] = 0x00;
+  pes[2] = 0x01;
+  pes[3] = 0xBD;
+  GST_WRITE_UINT16_BE (pes + 4, *size - 6);
+  pes[6] = 0x84;
+  pes[7] = 0x80;
+  pes[8] = 0x24;
+  pes[9] = 0x21 | ((pts >> 29) & 0x0E);
+  pes[10] = (pts >> 22) & 0xFF;
+  pes[11] = ((pts >> 14) & 0xFE) | 0x01;
+  pes[12] = (pts >> 7) & 0xFF;
+  pes[13] = ((pts << 1) & 0xFE) | 0x01;
+  memset (pes + 14, 0xFF, 45 - 14);
+
+  pes[45] = 0x10;
+  unit = pes + 46;
+  write_header (unit, 7, pgno, subtitle);
+  for (i = 1; i <= UNITS_PER_PES - 2; i++)
+    write_row (unit + i * DATA_UNIT_SIZE, 7 + i, pgno, i, rows[i - 1]);
+  write_header (unit + (UNITS_PER_PES - 1) * DATA_UNIT_SIZE, 7 + i,
+      pgno + 1, subtitle);
+
+  return pes;
+}
+
+/* Returns a PES packet with page @pgno, its rows saying which they are */
+static guint8 *
+make_pes (vbi_pgno pgno, guint64 pts, guint * size)
+{
+  gchar *rows[UNITS_PER_PES - 2];
+  guint8 *pes;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (rows); i++)
+    rows[i] = g_strdup_printf ("Row %u of page %03x", i + 1, pgno);
+  pes = make_page_pes (pgno, (const gchar * const *) rows, FALSE, pts, size);
+  for (i = 0; i < G_N_ELEMENTS (rows); i++)
+    g_free (rows[i]);
+
+  return pes;
+}
+
+static guint32
+crc32_mpeg (const guint8 * data, guint size)
+{
+  guint32 crc = 0xFFFFFFFF;
+  guint i, j;
+
+  for (i = 0; i < size; i++) {
+    crc ^= (guint32) data[i] << 24;
+    for (j = 0; j < 8; j++)
+      crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+  }
+
+  return crc;
+}
+
+/* Writes the transport stream packets carrying @size bytes of @data on
+ * @pid, padding the last one with an adaptation field, and returns how
+ * many there are */
+static guint
+write_ts (guint8 * ts, guint16 pid, const guint8 * data, guint size,
+    guint * cc)
+{
+  guint n = 0;
+
+  do {
+    guint8 *p = ts + n * TS_PACKET_SIZE;
+    guint chunk = MIN (size, TS_PACKET_SIZE - 4);
+    guint offset = 4;
+
+    p[0] = 0x47;
+    p[1] = (n == 0 ? 0x40 : 0) | (pid >> 8);
+    p[2] = pid & 0xFF;
+    p[3] = 0x10 | (*cc & 0xF);
+    (*cc)++;
+
+    if (chunk < TS_PACKET_SIZE - 4) {
+      guint stuffing = TS_PACKET_SIZE - 4 - chunk;
+
+      p[3] |= 0x20;
+      p[4] = stuffing - 1;
+      if (stuffing > 1) {
+        p[5] = 0x00;
+        memset (p + 6, 0xFF, stuffing - 2);
+      }
+      offset += stuffing;
+    }
+
+    memcpy (p + offset, data, chunk);
+    data += chunk;
+    size -= chunk;
+    n++;
+  } while (size > 0);
+
+  return n;
+}
+
+/* Writes the PSI section in @section, which starts with the pointer field
+ * and has room for the CRC after its @size bytes */
+static guint
+write_section (guint8 * ts, guint16 pid, guint8 * section, guint size,
+    guint * cc)
+{
+  guint32 crc;
+
+  /* from after the length field up to the end of the CRC */
+  GST_WRITE_UINT16_BE (section + 2, 0xB000 | size);
+  crc = crc32_mpeg (section + 1, size - 1);
+  GST_WRITE_UINT32_BE (section + size, crc);
+  section[0] = 0x00;
+
+  return write_ts (ts, pid, section, size + 4, cc);
+}
+
+/* Returns a transport stream with a PAT, a PMT announcing a teletext
+ * stream and one PES packet of it */
+static GstBuffer *
+make_ts (void)
+{
+  guint8 pat[1 + 12 + 4], pmt[1 + 12 + 5 + 7 + 4];
+  guint8 *pes, *ts;
+  guint pes_size, n = 0;
+  guint cc_pat = 0, cc_pmt = 0, cc_ttx = 0;
+  GstBuffer *buf;
+
+  ts = g_malloc0 (8 * TS_PACKET_SIZE);
+
+  /* pointer field, then the section from the table id */
+  pat[1] = 0x00;
+  GST_WRITE_UINT16_BE (pat + 4, 1);
+  pat[6] = 0xC1;
+  pat[7] = 0x00;
+  pat[8] = 0x00;
+  GST_WRITE_UINT16_BE (pat + 9, 1);
+  GST_WRITE_UINT16_BE (pat + 11, 0xE000 | PMT_PID);
+  n += write_section (ts + n * TS_PACKET_SIZE, 0, pat, 13, &cc_pat);
+
+  pmt[1] = 0x02;
+  GST_WRITE_UINT16_BE (pmt + 4, 1);
+  pmt[6] = 0xC1;
+  pmt[7] = 0x00;
+  pmt[8] = 0x00;
+  GST_WRITE_UINT16_BE (pmt + 9, 0xE000 | TELETEXT_PID);
+  GST_WRITE_UINT16_BE (pmt + 11, 0xF000);
+  pmt[13] = 0x06;
+  GST_WRITE_UINT16_BE (pmt + 14, 0xE000 | TELETEXT_PID);
+  GST_WRITE_UINT16_BE (pmt + 16, 0xF000 | 7);
+  /* teletext descriptor, initial page 100 */
+  pmt[18] = 0x56;
+  pmt[19] = 5;
+  memcpy (pmt + 20, "eng", 3);
+  pmt[23] = 0x01 << 3 | 1;
+  pmt[24] = 0x00;
+  n += write_section (ts + n * TS_PACKET_SIZE, PMT_PID, pmt, 25, &cc_pmt);
+
+  pes = make_pes (0x100, 90000, &pes_size);
+  n += write_ts (ts + n * TS_PACKET_SIZE, TELETEXT_PID, pes, pes_size,
+      &cc_ttx);
+  g_free (pes);
+
+  buf = gst_buffer_new ();
+  GST_BUFFER_DATA (buf) = GST_BUFFER_MALLOCDATA (buf) = ts;
+  GST_BUFFER_SIZE (buf) = n * TS_PACKET_SIZE;
+
+  return buf;
+}
+
+static GstFlowReturn
+output_chain (GstPad * pad, GstBuffer * buf)
+{
+  /* teletextdec prerolls text pads with an empty buffer */
+  if (GST_BUFFER_SIZE (buf) > 0) {
+    if (n_buffers++ == 0)
+      first_timestamp = GST_BUFFER_TIMESTAMP (buf);
+    gst_buffer_replace (&last_frame, buf);
+  }
+  gst_buffer_unref (buf);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+output_event (GstPad * pad, GstEvent * event)
+{
+  if (GST_EVENT_TYPE (event) == GST_EVENT_NEWSEGMENT) {
+    gst_event_parse_new_segment (event, NULL, NULL, &segment_format, NULL,
+        NULL, NULL);
+  }
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static void
+on_pad_added (GstElement * element, GstPad * pad, gpointer user_data)
+{
+  GstStaticPadTemplate *templ = (GstStaticPadTemplate *) user_data;
+
+  if (output_pad != NULL)
+    return;
+
+  output_pad = gst_pad_new_from_static_template (templ, "sink");
+  gst_pad_set_chain_function (output_pad, output_chain);
+  gst_pad_set_event_function (output_pad, output_event);
+  gst_pad_set_active (output_pad, TRUE);
+  gst_pad_link (pad, output_pad);
+}
+
+/* Starts @element with a pad of the program linked to its sink pad, on
+ * which a segment in @format is sent */
+static GstPad *
+start_element (GstElement * element, const gchar * caps_string,
+    GstFormat format)
+{
+  GstPad *src, *sink;
+  GstCaps *caps;
+
+  src = gst_pad_new ("src", GST_PAD_SRC);
+  sink = gst_element_get_static_pad (element, "sink");
+  gst_pad_link (src, sink);
+  gst_object_unref (sink);
+  gst_pad_set_active (src, TRUE);
+
+  caps = gst_caps_from_string (caps_string);
+  gst_pad_set_caps (src, caps);
+  gst_caps_unref (caps);
+
+  gst_element_set_state (element, GST_STATE_PLAYING);
+  gst_pad_push_event (src, gst_event_new_new_segment (FALSE, 1.0, format,
+          0, -1, 0));
+
+  return src;
+}
+
+static void
+stop_element (GstElement * element, GstPad * src)
+{
+  gst_element_set_state (element, GST_STATE_NULL);
+  gst_pad_set_active (src, FALSE);
+  gst_object_unref (src);
+  if (output_pad != NULL) {
+    gst_pad_set_active (output_pad, FALSE);
+    gst_object_unref (output_pad);
+    output_pad = NULL;
+  }
+  gst_buffer_replace (&last_frame, NULL);
+  gst_object_unref (element);
+}
+
+/* Links the always source pad of @element to a pad of the program made
+ * from @templ */
+static void
+link_static_pad (GstElement * element, GstStaticPadTemplate * templ)
+{
+  GstPad *pad = gst_element_get_static_pad (element, "src");
+
+  on_pad_added (element, pad, templ);
+  gst_object_unref (pad);
+}
+
+/* Pushes the generated transport stream through a teletexttsdec after a
+ * segment in @format, showing page @page or, if it is 0, the default
+ * page. Returns FALSE if no pad was added or no page pushed. */
+static gboolean
+run_tsdec (GstFormat format, gint page)
+{
+  GstElement *tsdec;
+  GstBuffer *buf;
+  GstFlowReturn ret;
+  GstPad *src;
+  gboolean ok;
+
+  tsdec = gst_element_factory_make ("teletexttsdec", NULL);
+  if (tsdec == NULL) {
+    g_printerr ("teletexttsdec not found\n");
+    return FALSE;
+  }
+  if (page != 0)
+    g_object_set (tsdec, "page", page, NULL);
+  g_signal_connect (tsdec, "pad-added", G_CALLBACK (on_pad_added),
+      &text_sink_template);
+
+  n_buffers = 0;
+  first_timestamp = GST_CLOCK_TIME_NONE;
+  segment_format = GST_FORMAT_UNDEFINED;
+  src = start_element (tsdec, "video/mpegts, systemstream=(boolean)true",
+      format);
+
+  buf = make_ts ();
+  gst_buffer_set_caps (buf, GST_PAD_CAPS (src));
+  ret = gst_pad_push (src, buf);
+  gst_pad_push_event (src, gst_event_new_eos ());
+
+  ok = output_pad != NULL && n_buffers > 0 &&
+      (ret == GST_FLOW_OK || ret == GST_FLOW_NOT_LINKED);
+  if (!ok) {
+    g_printerr ("pad %s, %d buffers, flow %s\n", output_pad ? "added" :
+        "missing", n_buffers, gst_flow_get_name (ret));
+  }
+  stop_element (tsdec, src);
+
+  return ok;
+}
+
+/* A PAT, a PMT and one teletext PES packet give a pad and a page */
+static void
+check_tsdec_finds_stream (void)
+{
+  CHECK (run_tsdec (GST_FORMAT_TIME, 100), "no page pushed");
+  g_print ("PASS %s\n", G_STRFUNC);
+}
+
+/* A byte segment from the start of the stream becomes a time segment, in
+ * which the first PTS is at 0 */
+static void
+check_tsdec_converts_segment (void)
+{
+  CHECK (run_tsdec (GST_FORMAT_BYTES, 100), "no page pushed");
+  CHECK (segment_format == GST_FORMAT_TIME, "segment in %s",
+      gst_format_get_name (segment_format));
+  CHECK (first_timestamp == 0, "first timestamp %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (first_timestamp));
+  g_print ("PASS %s\n", G_STRFUNC);
+}
+
+/* Without the page property set, page 100 is shown by the decoders too */
+static void
+check_tsdec_default_page (void)
+{
+  GstElement *tsdec;
+  gint page;
+
+  tsdec = gst_element_factory_make ("teletexttsdec", NULL);
+  CHECK (tsdec != NULL, "teletexttsdec not found");
+  g_object_get (tsdec, "page", &page, NULL);
+  gst_object_unref (tsdec);
+  CHECK (page == 100, "default page %d", page);
+
+  CHECK (run_tsdec (GST_FORMAT_TIME, 0), "page 100 not pushed");
+  g_print ("PASS %s\n", G_STRFUNC);
+}
+
+/* Decoding pages nobody shows allocates nothing after the first frames.
+ * Page 100 is shown while the stream carries pages 101 and 102, so that
+ * only the decode path runs. */
+static void
+check_decode_allocations (void)
+{
+  GstBuffer *bufs[WARMUP_FRAMES + COUNTED_FRAMES];
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstElement *dec;
+  GstPad *src;
+  gpointer probe;
+  guint i;
+  gint n;
+
+  n = g_atomic_int_get (&n_allocs);
+  probe = g_malloc (1);
+  g_free (probe);
+  if (g_atomic_int_get (&n_allocs) == n) {
+    g_print ("SKIP %s: GLib does not count allocations\n", G_STRFUNC);
+    return;
+  }
+
+  dec = gst_element_factory_make ("teletextdec", NULL);
+  CHECK (dec != NULL, "teletextdec not found");
+  g_object_set (dec, "page", 100, NULL);
+  link_static_pad (dec, &text_sink_template);
+  src = start_element (dec,
+      "video/mpeg, mpegversion=(int)2, systemstream=(boolean)true",
+      GST_FORMAT_TIME);
+
+  /* made up front, so that only the element allocates while counting */
+  for (i = 0; i < G_N_ELEMENTS (bufs); i++) {
+    guint size;
+
+    bufs[i] = gst_buffer_new ();
+    GST_BUFFER_DATA (bufs[i]) = GST_BUFFER_MALLOCDATA (bufs[i]) =
+        make_pes (0x101, 90000 + i * 3600, &size);
+    GST_BUFFER_SIZE (bufs[i]) = size;
+    GST_BUFFER_TIMESTAMP (bufs[i]) = i * GST_SECOND / 25;
+    gst_buffer_set_caps (bufs[i], GST_PAD_CAPS (src));
+  }
+
+  for (i = 0; i < WARMUP_FRAMES && ret == GST_FLOW_OK; i++)
+    ret = gst_pad_push (src, bufs[i]);
+  n = g_atomic_int_get (&n_allocs);
+  for (; i < G_N_ELEMENTS (bufs) && ret == GST_FLOW_OK; i++)
+    ret = gst_pad_push (src, bufs[i]);
+  n = g_atomic_int_get (&n_allocs) - n;
+  /* the ones left after an error */
+  for (; i < G_N_ELEMENTS (bufs); i++)
+    gst_buffer_unref (bufs[i]);
+
+  stop_element (dec, src);
+  CHECK (ret == GST_FLOW_OK, "flow %s", gst_flow_get_name (ret));
+  CHECK (n == 0, "%d allocations in %d frames", n, COUNTED_FRAMES);
+  g_print ("PASS %s\n", G_STRFUNC);
+}
+
+/* A page only shown on an unlinked request pad does not stop the stream
+ * while the always pad is linked */
+static void
+check_unlinked_page_pad (void)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstElement *dec;
+  GstPad *src, *page_pad;
+  guint i;
+
+  dec = gst_element_factory_make ("teletextdec", NULL);
+  CHECK (dec != NULL, "teletextdec not found");
+  /* page 101 is never completed by the stream */
+  g_object_set (dec, "page", 101, NULL);
+  page_pad = gst_element_get_request_pad (dec, "src_100");
+  CHECK (page_pad != NULL, "no pad for page 100");
+  link_static_pad (dec, &text_sink_template);
+  src = start_element (dec,
+      "video/mpeg, mpegversion=(int)2, systemstream=(boolean)true",
+      GST_FORMAT_TIME);
+
+  for (i = 0; i < 4 && ret == GST_FLOW_OK; i++) {
+    GstBuffer *buf = gst_buffer_new ();
+    guint size;
+
+    GST_BUFFER_DATA (buf) = GST_BUFFER_MALLOCDATA (buf) =
+        make_pes (0x100, 90000 + i * 3600, &size);
+    GST_BUFFER_SIZE (buf) = size;
+    GST_BUFFER_TIMESTAMP (buf) = i * GST_SECOND / 25;
+    gst_buffer_set_caps (buf, GST_PAD_CAPS (src));
+    ret = gst_pad_push (src, buf);
+  }
+
+  gst_element_release_request_pad (dec, page_pad);
+  gst_object_unref (page_pad);
+  stop_element (dec, src);
+  CHECK (ret == GST_FLOW_OK, "flow %s", gst_flow_get_name (ret));
+  g_print ("PASS %s\n", G_STRFUNC);
+}
+
+/* Returns the RGBA frame teletextdec draws of the page of render_rows with
+ * renderer @renderer, or NULL */
+static GstBuffer *
+render_page (const gchar * renderer, gboolean subtitles_mode)
+{
+  GstElement *dec;
+  GstBuffer *buf, *frame = NULL;
+  GstFlowReturn ret;
+  GstPad *src;
+  guint size;
+
+  dec = gst_element_factory_make ("teletextdec", NULL);
+  if (dec == NULL) {
+    g_printerr ("teletextdec not found\n");
+    return NULL;
+  }
+  g_object_set (dec, "page", 100, "subtitles-mode", subtitles_mode, NULL);
+  gst_util_set_object_arg (G_OBJECT (dec), "renderer", renderer);
+  link_static_pad (dec, &rgba_sink_template);
+  src = start_element (dec,
+      "video/mpeg, mpegversion=(int)2, systemstream=(boolean)true",
+      GST_FORMAT_TIME);
+
+  buf = gst_buffer_new ();
+  GST_BUFFER_DATA (buf) = GST_BUFFER_MALLOCDATA (buf) =
+      make_page_pes (0x100, render_rows, TRUE, 90000, &size);
+  GST_BUFFER_SIZE (buf) = size;
+  GST_BUFFER_TIMESTAMP (buf) = 0;
+  gst_buffer_set_caps (buf, GST_PAD_CAPS (src));
+  ret = gst_pad_push (src, buf);
+
+  if (ret == GST_FLOW_OK && last_frame != NULL)
+    frame = gst_buffer_ref (last_frame);
+  else
+    g_printerr ("%s: flow %s, %s frame\n", renderer,
+        gst_flow_get_name (ret), last_frame ? "a" : "no");
+  stop_element (dec, src);
+
+  return frame;
+}
+
+/* The glyph cache draws the same pixels as zvbi, also where the subtitle
+ * opacity is applied after the cells are copied */
+static void
+check_renderers_match (void)
+{
+  gboolean subtitles_mode;
+
+  for (subtitles_mode = FALSE; subtitles_mode <= TRUE; subtitles_mode++) {
+    GstBuffer *zvbi, *glyphs;
+    gboolean same;
+
+    zvbi = render_page ("zvbi", subtitles_mode);
+    glyphs = render_page ("glyph-cache", subtitles_mode);
+    same = zvbi != NULL && glyphs != NULL &&
+        GST_BUFFER_SIZE (zvbi) == GST_BUFFER_SIZE (glyphs) &&
+        memcmp (GST_BUFFER_DATA (zvbi), GST_BUFFER_DATA (glyphs),
+        GST_BUFFER_SIZE (zvbi)) == 0;
+    if (zvbi != NULL)
+      gst_buffer_unref (zvbi);
+    if (glyphs != NULL)
+      gst_buffer_unref (glyphs);
+    CHECK (same, "frames differ with subtitles-mode %s",
+        subtitles_mode ? "on" : "off");
+  }
+  g_print ("PASS %s\n", G_STRFUNC);
+}
+
+int
+main (int argc, char **argv)
+{
+  /* before GLib allocates anything, with the slices taken from it too */
+  setenv ("G_SLICE", "always-malloc", 1);
+  g_mem_set_vtable (&counting_vtable);
+
+  gst_init (&argc, &argv);
+
+  check_tsdec_finds_stream ();
+  check_tsdec_converts_segment ();
+  check_tsdec_default_page ();
+  check_decode_allocations ();
+  check_unlinked_page_pad ();
+  check_renderers_match ();
+
+  return n_failed > 0 ? 1 : 0;
+}
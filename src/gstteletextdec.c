@@ -24,11 +24,19 @@
  *
  * Decode PES stream containing teletext information to RGBA stream
  *
+ * Besides the always source pad, which outputs the page selected with the
+ * #GstTeletextDec:page and #GstTeletextDec:subpage properties, src_%03d pads
+ * can be requested to output further pages, e.g. src_888 for page 888. All
+ * pages are decoded from a single demuxer and decoder.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
  * gst-launch -v -m filesrc location=recording.mpeg ! mpegtsdemux ! private/teletext ! teletextdec ! ffmpegcolorspace ! ximagesink
  * ]|
+ * |[
+ * gst-launch -v filesrc location=recording.mpeg ! mpegtsdemux ! private/teletext ! teletextdec name=dec subtitles-mode=TRUE ! text/plain ! fakesink  dec.src_777 ! text/plain ! fakesink
+ * ]|
  * </refsect2>
  */
 
@@ -47,6 +55,20 @@ GST_DEBUG_CATEGORY_STATIC (gst_teletextdec_debug);
 
 #define SUBTITLES_PAGE 888
 #define MAX_SLICES 32
+/* must be a power of two */
+#define PAGE_QUEUE_SIZE 256
+#define DEFAULT_MAX_QUEUE_SIZE 64
+#define HTML_BUFFER_SIZE (16 * 1024)
+/* released output buffers kept per pad */
+#define POOL_MAX_FREE 8
+/* pages handed to the export pool but not pushed yet */
+#define EXPORT_MAX_PENDING 16
+/* vbi_decode() expects the frames 1/30 to 1/25 s apart */
+#define FRAME_PERIOD 0.04
+#define MIN_FRAME_DELTA 0.025
+#define MAX_FRAME_DELTA 0.05
+/* longest gap filled with empty frames, in seconds */
+#define MAX_FILLED_GAP 1.0
 
 /* Filter signals and args */
 enum
@@ -60,7 +82,22 @@ enum
   PROP_PAGENO,
   PROP_SUBNO,
   PROP_SUBTITLES_MODE,
-  PROP_SUBS_TEMPLATE
+  PROP_SUBS_TEMPLATE,
+  PROP_MAX_PARITY_ERRORS,
+  PROP_DEDUPLICATE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_EXPORT_THREADS,
+  PROP_CACHE_FILE,
+  PROP_CACHE_SAVE_INTERVAL,
+  PROP_SUBTITLES_CHANGE_ONLY,
+  PROP_MAX_QUEUE_SIZE,
+  PROP_LEAKY,
+  PROP_RENDERER,
+  PROP_PAGE_FILTER,
+  PROP_MAX_CACHE_PAGES,
+  PROP_CACHE_PAGE_SET,
+  PROP_CACHE_MEMORY
 };
 
 enum
@@ -88,11 +125,65 @@ typedef enum
   DATA_UNIT_STUFFING = 0xFF,
 } data_unit_id;
 
+/* size of a character cell in the RGBA output */
+#define GLYPH_WIDTH 12
+#define GLYPH_HEIGHT 10
+/* glyph tiles kept per pad, the cache starts over beyond that */
+#define MAX_GLYPH_TILES 4096
+
+/* What a character cell of normal size looks like when drawn */
+typedef struct
+{
+  vbi_rgba foreground;
+  vbi_rgba background;
+  guint32 unicode;
+  guint32 attributes;
+} glyph_key;
+
+typedef struct
+{
+  glyph_key key;
+  vbi_rgba pixels[GLYPH_WIDTH * GLYPH_HEIGHT];
+} glyph_tile;
+
+/* rough size of a subpage in the zvbi page cache, with its bookkeeping */
+#define ZVBI_SUBPAGE_SIZE 2048
+
+#define CACHE_MAGIC "TTXCACHE"
+#define CACHE_VERSION 2
+/* reads back differently on a host of another byte order */
+#define CACHE_BYTE_ORDER 0x01020304
+
+/* Header of the page cache file. It is followed by the pages as vbi_page
+ * structures, sorted by page number and with their pointers cleared, so
+ * they are only read back by the zvbi version and byte order that wrote
+ * them. */
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint32 zvbi_version;
+  guint32 page_size;
+  guint32 cni;
+  guint32 n_pages;
+} cache_header;
+
+/* A page exported for one pad on the export pool */
 typedef struct
 {
-  int pgno;
-  int subno;
-} page_info;
+  guint64 seqnum;
+  GstTeletextOutput *output;
+  /* Copy of the fetched page, or NULL when it was exported into buf before
+   * queueing or is unchanged and only updates the segment */
+  vbi_page *page;
+  GstClockTime timestamp;
+  GstClockTime duration;
+
+  GstBuffer *buf;
+  GstClockTime export_time;
+  GstFlowReturn ret;
+} export_job;
 
 typedef enum
 {
@@ -110,7 +201,18 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_RGBA "; text/plain ; text/html")
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_RGBA "; " GST_VIDEO_CAPS_BGRA "; "
+        GST_VIDEO_CAPS_YUV ("AYUV") "; " GST_VIDEO_CAPS_YUV ("A420")
+        "; text/plain ; text/html")
+    );
+
+static GstStaticPadTemplate src_page_template =
+GST_STATIC_PAD_TEMPLATE ("src_%03d",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_RGBA "; " GST_VIDEO_CAPS_BGRA "; "
+        GST_VIDEO_CAPS_YUV ("AYUV") "; " GST_VIDEO_CAPS_YUV ("A420")
+        "; text/plain ; text/html")
     );
 
 /* debug category for filtering log messages */
@@ -128,8 +230,13 @@ static void gst_teletextdec_finalize (GObject * object);
 
 static GstStateChangeReturn gst_teletextdec_change_state (GstElement * element,
     GstStateChange transition);
+static GstPad *gst_teletextdec_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name);
+static void gst_teletextdec_release_pad (GstElement * element, GstPad * pad);
 
 static GstFlowReturn gst_teletextdec_chain (GstPad * pad, GstBuffer * buf);
+static GstFlowReturn gst_teletextdec_chain_list (GstPad * pad,
+    GstBufferList * list);
 static gboolean gst_teletextdec_sink_setcaps (GstPad * pad, GstCaps * caps);
 static gboolean gst_teletextdec_sink_event (GstPad * pad, GstEvent * event);
 static GstPadLinkReturn gst_teletextdec_src_set_caps (GstPad * pad,
@@ -141,25 +248,276 @@ static void gst_teletextdec_event_handler (vbi_event * ev, void *user_data);
 
 static GstFlowReturn gst_teletextdec_push_page (GstTeletextDec * teletext);
 static GstFlowReturn gst_teletextdec_export_text_page (GstTeletextDec *
-    teletext, vbi_page * page, GstBuffer ** buf);
+    teletext, GstTeletextOutput * output, vbi_page * page, GstBuffer ** buf);
 static GstFlowReturn gst_teletextdec_export_html_page (GstTeletextDec *
-    teletext, vbi_page * page, GstBuffer ** buf);
+    teletext, GstTeletextOutput * output, vbi_page * page, GstBuffer ** buf);
 static GstFlowReturn gst_teletextdec_export_rgba_page (GstTeletextDec *
-    teletext, vbi_page * page, GstBuffer ** buf);
+    teletext, GstTeletextOutput * output, vbi_page * page, GstBuffer ** buf);
 
-static gboolean gst_teletextdec_push_preroll_buffer (GstTeletextDec * teletext);
+static gboolean gst_teletextdec_push_preroll_buffer (GstTeletextDec * teletext,
+    GstPad * pad);
 static void gst_teletextdec_process_telx_buffer (GstTeletextDec * teletext,
     GstBuffer * buf);
 static void gst_teletextdec_process_pes_buffer (GstTeletextDec * teletext,
     GstBuffer * buf);
-static gboolean gst_teletextdec_extract_data_units (GstTeletextDec * teletext,
+static gint gst_teletextdec_extract_data_units (GstTeletextDec * teletext,
     GstTeletextFrame * f, guint8 * packet, guint * offset, gint size);
 
 static void gst_teletextdec_zvbi_init (GstTeletextDec * teletext);
 static void gst_teletextdec_zvbi_clear (GstTeletextDec * teletext);
+static void gst_teletextdec_reset_frame (GstTeletextDec * teletext);
+static void gst_teletextdec_output_reset (GstTeletextOutput * output);
+static void gst_teletextdec_output_free (GstTeletextOutput * output);
+static GstFlowReturn gst_teletextdec_push_held (GstTeletextDec * teletext);
+static GstStructure *gst_teletextdec_get_stats (GstTeletextDec * teletext);
+static GstFlowReturn gst_teletextdec_drain_exports (GstTeletextDec * teletext);
+static void gst_teletextdec_export_func (gpointer data, gpointer user_data);
+static GstFlowReturn gst_teletextdec_serve_snapshot (GstTeletextDec *
+    teletext);
+static GstFlowReturn gst_teletextdec_show_new_page (GstTeletextDec *
+    teletext);
+static void gst_teletextdec_load_cache (GstTeletextDec * teletext);
+static void gst_teletextdec_save_cache (GstTeletextDec * teletext,
+    gboolean wait);
+static void gst_teletextdec_join_cache_thread (GstTeletextDec * teletext);
+static void gst_teletextdec_drop_snapshot (GstTeletextDec * teletext);
+static void gst_teletextdec_set_subtitles_template (GstTeletextDec *
+    teletext, const gchar * template);
+static void gst_teletextdec_init_utf8_table (void);
+static void gst_teletextdec_set_cache_page_set (GstTeletextDec * teletext,
+    const gchar * set);
 
 /* GObject vmethod implementations */
 
+#define GST_TYPE_TELETEXTDEC_LEAKY (gst_teletextdec_leaky_get_type ())
+static GType
+gst_teletextdec_leaky_get_type (void)
+{
+  static GType leaky_type = 0;
+  static const GEnumValue leaky[] = {
+    {GST_TELETEXTDEC_LEAKY_NO, "Not Leaky: refuse new pages with a warning",
+        "no"},
+    {GST_TELETEXTDEC_LEAKY_UPSTREAM, "Leaky on upstream (new pages)",
+        "upstream"},
+    {GST_TELETEXTDEC_LEAKY_DOWNSTREAM, "Leaky on downstream (old pages)",
+        "downstream"},
+    {0, NULL, NULL},
+  };
+
+  if (!leaky_type) {
+    leaky_type = g_enum_register_static ("GstTeletextDecLeaky", leaky);
+  }
+  return leaky_type;
+}
+
+#define GST_TYPE_TELETEXTDEC_RENDERER (gst_teletextdec_renderer_get_type ())
+static GType
+gst_teletextdec_renderer_get_type (void)
+{
+  static GType renderer_type = 0;
+  static const GEnumValue renderer[] = {
+    {GST_TELETEXTDEC_RENDERER_ZVBI, "Draw the pages with zvbi", "zvbi"},
+    {GST_TELETEXTDEC_RENDERER_GLYPH_CACHE,
+        "Copy character cells cached per pad", "glyph-cache"},
+    {0, NULL, NULL},
+  };
+
+  if (!renderer_type) {
+    renderer_type = g_enum_register_static ("GstTeletextDecRenderer",
+        renderer);
+  }
+  return renderer_type;
+}
+
+static GstBufferClass *teletext_buffer_parent_class = NULL;
+
+#define GST_TELETEXT_BUFFER_CAPACITY(buf) (((GstTeletextBuffer *) (buf))->capacity)
+
+static void gst_teletextdec_pool_unref (GstTeletextBufferPool * pool);
+
+/* Puts @buffer back in its pool instead of freeing it while the pool is
+ * active and the caps have not changed */
+static void
+gst_teletext_buffer_finalize (GstTeletextBuffer * buffer)
+{
+  GstTeletextBufferPool *pool = buffer->pool;
+  GstBuffer *buf = GST_BUFFER_CAST (buffer);
+  gboolean recycle;
+
+  g_mutex_lock (pool->lock);
+  recycle = pool->active && pool->n_free < POOL_MAX_FREE &&
+      GST_BUFFER_CAPS (buf) == pool->caps;
+  if (recycle) {
+    /* resurrect the buffer, it is unreffed again when the pool drops it */
+    gst_buffer_ref (buf);
+    GST_BUFFER_FLAGS (buf) = 0;
+    GST_BUFFER_TIMESTAMP (buf) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DURATION (buf) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_OFFSET (buf) = GST_BUFFER_OFFSET_NONE;
+    GST_BUFFER_OFFSET_END (buf) = GST_BUFFER_OFFSET_NONE;
+    pool->free = g_slist_prepend (pool->free, buffer);
+    pool->n_free++;
+  }
+  g_mutex_unlock (pool->lock);
+  if (recycle)
+    return;
+
+  gst_teletextdec_pool_unref (pool);
+  GST_MINI_OBJECT_CLASS (teletext_buffer_parent_class)->finalize
+      (GST_MINI_OBJECT_CAST (buffer));
+}
+
+static void
+gst_teletext_buffer_class_init (gpointer g_class, gpointer class_data)
+{
+  GstMiniObjectClass *mini_object_class = GST_MINI_OBJECT_CLASS (g_class);
+
+  teletext_buffer_parent_class = g_type_class_peek_parent (g_class);
+  mini_object_class->finalize = (GstMiniObjectFinalizeFunction)
+      gst_teletext_buffer_finalize;
+}
+
+#define GST_TYPE_TELETEXT_BUFFER (gst_teletext_buffer_get_type ())
+static GType
+gst_teletext_buffer_get_type (void)
+{
+  static GType buffer_type = 0;
+  static const GTypeInfo buffer_info = {
+    sizeof (GstBufferClass), NULL, NULL, gst_teletext_buffer_class_init,
+    NULL, NULL, sizeof (GstTeletextBuffer), 0, NULL, NULL
+  };
+
+  if (!buffer_type) {
+    buffer_type = g_type_register_static (GST_TYPE_BUFFER,
+        "GstTeletextBuffer", &buffer_info, 0);
+  }
+  return buffer_type;
+}
+
+static GstTeletextBufferPool *
+gst_teletextdec_pool_new (void)
+{
+  GstTeletextBufferPool *pool = g_new0 (GstTeletextBufferPool, 1);
+
+  pool->refcount = 1;
+  pool->lock = g_mutex_new ();
+  pool->active = TRUE;
+
+  return pool;
+}
+
+static void
+gst_teletextdec_pool_unref (GstTeletextBufferPool * pool)
+{
+  if (!g_atomic_int_dec_and_test (&pool->refcount))
+    return;
+
+  if (pool->caps != NULL)
+    gst_caps_unref (pool->caps);
+  g_mutex_free (pool->lock);
+  g_free (pool);
+}
+
+/* Drops the released buffers. Called with the pool unlocked, as they take
+ * the lock when they are finalized. */
+static void
+gst_teletextdec_pool_drop (GSList * free)
+{
+  g_slist_foreach (free, (GFunc) gst_mini_object_unref, NULL);
+  g_slist_free (free);
+}
+
+/* Sets the caps of the buffers handed out from now on. Buffers with other
+ * caps are not reused. Does nothing if @caps did not change, so it can be
+ * called with the caps of every page. */
+static void
+gst_teletextdec_pool_set_caps (GstTeletextBufferPool * pool, GstCaps * caps)
+{
+  GstCaps *old_caps;
+  GSList *free;
+
+  g_mutex_lock (pool->lock);
+  if (pool->caps == caps || (pool->caps != NULL && caps != NULL &&
+          gst_caps_is_equal (pool->caps, caps))) {
+    g_mutex_unlock (pool->lock);
+    return;
+  }
+  old_caps = pool->caps;
+  pool->caps = caps != NULL ? gst_caps_ref (caps) : NULL;
+  free = pool->free;
+  pool->free = NULL;
+  pool->n_free = 0;
+  g_mutex_unlock (pool->lock);
+
+  gst_teletextdec_pool_drop (free);
+  if (old_caps != NULL)
+    gst_caps_unref (old_caps);
+}
+
+/* Stops reusing buffers and drops the reference of the pad */
+static void
+gst_teletextdec_pool_close (GstTeletextBufferPool * pool)
+{
+  GSList *free;
+
+  g_mutex_lock (pool->lock);
+  pool->active = FALSE;
+  free = pool->free;
+  pool->free = NULL;
+  pool->n_free = 0;
+  g_mutex_unlock (pool->lock);
+
+  gst_teletextdec_pool_drop (free);
+  gst_teletextdec_pool_unref (pool);
+}
+
+/* Makes room for @size bytes in @buf, a buffer of a pool. The data is not
+ * kept. */
+static void
+gst_teletextdec_buffer_reserve (GstBuffer * buf, guint size)
+{
+  GstTeletextBuffer *buffer = (GstTeletextBuffer *) buf;
+
+  if (buffer->capacity < size) {
+    g_free (GST_BUFFER_MALLOCDATA (buf));
+    GST_BUFFER_MALLOCDATA (buf) = g_malloc (size);
+    GST_BUFFER_DATA (buf) = GST_BUFFER_MALLOCDATA (buf);
+    buffer->capacity = size;
+  }
+  GST_BUFFER_SIZE (buf) = size;
+}
+
+/* Returns a buffer of @size bytes with the caps of @pool, a released one
+ * if there is one */
+static GstBuffer *
+gst_teletextdec_pool_acquire (GstTeletextBufferPool * pool, guint size)
+{
+  GstTeletextBuffer *buffer = NULL;
+  GstCaps *caps;
+
+  g_mutex_lock (pool->lock);
+  if (pool->free != NULL) {
+    buffer = (GstTeletextBuffer *) pool->free->data;
+    pool->free = g_slist_delete_link (pool->free, pool->free);
+    pool->n_free--;
+  }
+  caps = pool->caps != NULL ? gst_caps_ref (pool->caps) : NULL;
+  g_mutex_unlock (pool->lock);
+
+  if (buffer == NULL) {
+    buffer = (GstTeletextBuffer *)
+        gst_mini_object_new (GST_TYPE_TELETEXT_BUFFER);
+    g_atomic_int_inc (&pool->refcount);
+    buffer->pool = pool;
+    gst_buffer_set_caps (GST_BUFFER_CAST (buffer), caps);
+  }
+  if (caps != NULL)
+    gst_caps_unref (caps);
+
+  gst_teletextdec_buffer_reserve (GST_BUFFER_CAST (buffer), size);
+  return GST_BUFFER_CAST (buffer);
+}
+
 static void
 gst_teletextdec_base_init (gpointer klass)
 {
@@ -174,6 +532,8 @@ gst_teletextdec_base_init (gpointer klass)
 
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&src_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_page_template));
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&sink_template));
 }
@@ -192,6 +552,10 @@ gst_teletextdec_class_init (GstTeletextDecClass * klass)
 
   gstelement_class = GST_ELEMENT_CLASS (klass);
   gstelement_class->change_state = gst_teletextdec_change_state;
+  gstelement_class->request_new_pad = gst_teletextdec_request_new_pad;
+  gstelement_class->release_pad = gst_teletextdec_release_pad;
+
+  gst_teletextdec_init_utf8_table ();
 
   g_object_class_install_property (gobject_class, PROP_PAGENO,
       g_param_spec_int ("page", "Page number",
@@ -212,6 +576,93 @@ gst_teletextdec_class_init (GstTeletextDecClass * klass)
       g_param_spec_string ("subtitles-template", "Subtitles output template",
           "Output template used to print each one of the subtitles lines",
           "%s\n", G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_PARITY_ERRORS,
+      g_param_spec_int ("max-parity-errors", "Maximum parity errors",
+          "Drop teletext lines with more bytes failing the parity check "
+          "(-1 to keep all lines)", -1, 42, -1, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_DEDUPLICATE,
+      g_param_spec_boolean ("deduplicate", "Deduplicate pages",
+          "Only push a page when its content changed since it was last pushed "
+          "on the pad, and a segment update otherwise", FALSE,
+          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Counters of the data units, frames and pages processed and "
+          "histograms of the export times", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Statistics interval",
+          "Post the statistics as element message every that many "
+          "milliseconds (0 = never)", 0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_EXPORT_THREADS,
+      g_param_spec_uint ("export-threads", "Export threads",
+          "Number of threads exporting pages, 0 to export them on the "
+          "streaming thread. Takes effect when going to PAUSED",
+          0, 16, 0, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_FILE,
+      g_param_spec_string ("cache-file", "Page cache file",
+          "File the received pages are saved to when stopping and loaded "
+          "from when starting, to show them before they are transmitted "
+          "again", NULL, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_SAVE_INTERVAL,
+      g_param_spec_uint ("cache-save-interval", "Page cache save interval",
+          "Also save the page cache every that many seconds (0 = only when "
+          "stopping)", 0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_SUBTITLES_CHANGE_ONLY,
+      g_param_spec_boolean ("subtitles-change-only",
+          "Push subtitles on change only",
+          "In subtitles mode, only push a subtitle when the text changes, "
+          "lasting until the next change or clear, and segment updates while "
+          "no subtitle is shown. A subtitle is pushed once it has been "
+          "replaced", FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_QUEUE_SIZE,
+      g_param_spec_uint ("max-queue-size", "Maximum queue size",
+          "Maximum number of received pages waiting to be rendered", 1,
+          PAGE_QUEUE_SIZE, DEFAULT_MAX_QUEUE_SIZE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_LEAKY,
+      g_param_spec_enum ("leaky", "Leaky",
+          "Where the page queue drops pages once it holds max-queue-size "
+          "pages", GST_TYPE_TELETEXTDEC_LEAKY, GST_TELETEXTDEC_LEAKY_NO,
+          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_RENDERER,
+      g_param_spec_enum ("renderer", "Renderer",
+          "How RGBA pages are drawn. The glyph cache draws every distinct "
+          "character cell once with zvbi and copies it from then on, with "
+          "the same result", GST_TYPE_TELETEXTDEC_RENDERER,
+          GST_TELETEXTDEC_RENDERER_ZVBI, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_PAGE_FILTER,
+      g_param_spec_boolean ("page-filter", "Page filter",
+          "Only decode the packets of the pages shown on a pad. Other pages "
+          "are not cached, so a newly selected page is only shown once it "
+          "is transmitted again", FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_CACHE_PAGES,
+      g_param_spec_uint ("max-cache-pages", "Maximum cached pages",
+          "Maximum number of pages decoded and kept besides the pages shown "
+          "(0 = unlimited)", 0, 800, 0, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_PAGE_SET,
+      g_param_spec_string ("cache-page-set", "Cached page set",
+          "Pages decoded and kept besides the pages shown, as comma "
+          "separated page numbers and ranges like \"100-199,888\" "
+          "(NULL = all)", NULL, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_MEMORY,
+      g_param_spec_uint64 ("cache-memory", "Cache memory",
+          "Estimate of the memory used by the page cache of the decoder, "
+          "in bytes", 0, G_MAXUINT64, 0, G_PARAM_READABLE));
 }
 
 /* initialize the new element
@@ -220,12 +671,16 @@ gst_teletextdec_class_init (GstTeletextDecClass * klass)
 static void
 gst_teletextdec_init (GstTeletextDec * teletext, GstTeletextDecClass * klass)
 {
+  GstTeletextOutput *output;
+
   /* Create sink pad */
   teletext->sinkpad = gst_pad_new_from_static_template (&sink_template, "sink");
   gst_pad_set_setcaps_function (teletext->sinkpad,
       GST_DEBUG_FUNCPTR (gst_teletextdec_sink_setcaps));
   gst_pad_set_chain_function (teletext->sinkpad,
       GST_DEBUG_FUNCPTR (gst_teletextdec_chain));
+  gst_pad_set_chain_list_function (teletext->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_teletextdec_chain_list));
   gst_pad_set_event_function (teletext->sinkpad,
       GST_DEBUG_FUNCPTR (gst_teletextdec_sink_event));
   gst_element_add_pad (GST_ELEMENT (teletext), teletext->sinkpad);
@@ -236,12 +691,42 @@ gst_teletextdec_init (GstTeletextDec * teletext, GstTeletextDecClass * klass)
       GST_DEBUG_FUNCPTR (gst_teletextdec_src_set_caps));
   gst_element_add_pad (GST_ELEMENT (teletext), teletext->srcpad);
 
+  /* the always pad follows the page and subpage properties */
+  output = g_new0 (GstTeletextOutput, 1);
+  output->pad = teletext->srcpad;
+  output->output_format = GST_TELETEXTDEC_OUTPUT_FORMAT_RGBA;
+  output->pool = gst_teletextdec_pool_new ();
+  output->lock = g_mutex_new ();
+  gst_pad_set_element_private (teletext->srcpad, output);
+  teletext->outputs = g_list_append (NULL, output);
+
   teletext->demux = NULL;
   teletext->decoder = NULL;
+  teletext->exporter = NULL;
+  teletext->exporter_lock = g_mutex_new ();
+  teletext->stats_lock = g_mutex_new ();
   teletext->pageno = 0x100;
   teletext->subno = -1;
+  teletext->page_changed = FALSE;
   teletext->subtitles_mode = FALSE;
-  teletext->subtitles_template = "%s\n";
+  teletext->subtitles_template = NULL;
+  teletext->subtitles_prefix = NULL;
+  teletext->subtitles_suffix = NULL;
+  gst_teletextdec_set_subtitles_template (teletext, "%s\n");
+  teletext->max_parity_errors = -1;
+  teletext->deduplicate = FALSE;
+  teletext->subtitles_change_only = FALSE;
+  teletext->max_queue_size = DEFAULT_MAX_QUEUE_SIZE;
+  teletext->leaky = GST_TELETEXTDEC_LEAKY_NO;
+  teletext->renderer = GST_TELETEXTDEC_RENDERER_ZVBI;
+  teletext->page_filter = FALSE;
+  teletext->max_cache_pages = 0;
+  teletext->cache_page_set = NULL;
+  teletext->stats_interval = 0;
+  teletext->export_threads = 0;
+  teletext->cache_file = NULL;
+  teletext->cache_save_interval = 0;
+  gst_segment_init (&teletext->segment, GST_FORMAT_UNDEFINED);
 
   teletext->in_timestamp = GST_CLOCK_TIME_NONE;
   teletext->in_duration = GST_CLOCK_TIME_NONE;
@@ -249,14 +734,37 @@ gst_teletextdec_init (GstTeletextDec * teletext, GstTeletextDecClass * klass)
   teletext->rate_numerator = 0;
   teletext->rate_denominator = 1;
 
-  teletext->queue = NULL;
-  teletext->queue_lock = g_mutex_new ();
+  teletext->queue = g_new (GstTeletextPageInfo, PAGE_QUEUE_SIZE);
+  teletext->queue_head = 0;
+  teletext->queue_tail = 0;
 
   teletext->frame = g_new0 (GstTeletextFrame, 1);
   teletext->frame->sliced_begin = g_new (vbi_sliced, MAX_SLICES);
+  gst_teletextdec_reset_frame (teletext);
 
   teletext->last_ts = 0;
 
+  memset (&teletext->stats, 0, sizeof (GstTeletextStats));
+  memset (&teletext->published_stats, 0, sizeof (GstTeletextStats));
+  teletext->last_stats_post = GST_CLOCK_TIME_NONE;
+
+  teletext->snapshot = NULL;
+  teletext->n_snapshot_pages = 0;
+  teletext->snapshot_cni = 0;
+  teletext->snapshot_served = FALSE;
+  teletext->network_cni = 0;
+  teletext->last_cache_save = GST_CLOCK_TIME_NONE;
+  teletext->cache_image = NULL;
+  teletext->cache_image_file = NULL;
+  teletext->cache_thread = NULL;
+  teletext->cache_writing = FALSE;
+
+  teletext->export_pool = NULL;
+  teletext->export_lock = g_mutex_new ();
+  teletext->export_cond = g_cond_new ();
+  teletext->export_done = NULL;
+  teletext->export_pushing = FALSE;
+
   teletext->process_buf_func = NULL;
 }
 
@@ -265,10 +773,28 @@ gst_teletextdec_finalize (GObject * object)
 {
   GstTeletextDec *teletext = GST_TELETEXTDEC (object);
 
-  g_mutex_free (teletext->queue_lock);
-
+  gst_teletextdec_join_cache_thread (teletext);
+  g_free (teletext->cache_image);
+
+  g_free (teletext->queue);
+  g_mutex_free (teletext->exporter_lock);
+  g_mutex_free (teletext->stats_lock);
+  g_mutex_free (teletext->export_lock);
+  g_cond_free (teletext->export_cond);
+  g_free (teletext->cache_file);
+  g_free (teletext->cache_page_set);
+  g_free (teletext->subtitles_template);
+  g_free (teletext->subtitles_prefix);
+  g_free (teletext->subtitles_suffix);
+
+  g_free (teletext->filtered);
+  g_free (teletext->frame->sliced_begin);
   g_free (teletext->frame);
 
+  g_list_foreach (teletext->outputs, (GFunc) gst_teletextdec_output_free,
+      NULL);
+  g_list_free (teletext->outputs);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -282,12 +808,16 @@ gst_teletextdec_zvbi_init (GstTeletextDec * teletext)
   teletext->decoder = vbi_decoder_new ();
 
   vbi_event_handler_register (teletext->decoder,
-      VBI_EVENT_TTX_PAGE | VBI_EVENT_CAPTION,
+      VBI_EVENT_TTX_PAGE | VBI_EVENT_CAPTION | VBI_EVENT_NETWORK,
       gst_teletextdec_event_handler, teletext);
 
-  g_mutex_lock (teletext->queue_lock);
-  teletext->queue = g_queue_new ();
-  g_mutex_unlock (teletext->queue_lock);
+  memset (teletext->pages_dirty, 0, sizeof (teletext->pages_dirty));
+  memset (teletext->magazine_kept, 0, sizeof (teletext->magazine_kept));
+  memset (teletext->pages_admitted, 0, sizeof (teletext->pages_admitted));
+  teletext->n_pages_admitted = 0;
+  memset (teletext->cached_subpages, 0, sizeof (teletext->cached_subpages));
+  g_atomic_int_set (&teletext->n_cached_subpages, 0);
+  teletext->network_cni = 0;
 }
 
 static void
@@ -297,25 +827,29 @@ gst_teletextdec_zvbi_clear (GstTeletextDec * teletext)
 
   GST_LOG_OBJECT (teletext, "Clearing structures");
 
+  /* the export pool may still be using the pages and outputs */
+  gst_teletextdec_drain_exports (teletext);
+
   if (teletext->demux != NULL) {
     vbi_dvb_demux_delete (teletext->demux);
     teletext->demux = NULL;
   }
+  g_atomic_int_set (&teletext->n_cached_subpages, 0);
   if (teletext->decoder != NULL) {
     vbi_decoder_delete (teletext->decoder);
     teletext->decoder = NULL;
   }
-  if (teletext->frame != NULL) {
-    g_free (teletext->frame);
-    teletext->frame = NULL;
+  if (teletext->exporter != NULL) {
+    vbi_export_delete (teletext->exporter);
+    teletext->exporter = NULL;
   }
+  gst_teletextdec_reset_frame (teletext);
+  g_list_foreach (teletext->outputs, (GFunc) gst_teletextdec_output_reset,
+      NULL);
 
-  g_mutex_lock (teletext->queue_lock);
-  if (teletext->queue != NULL) {
-    g_queue_free (teletext->queue);
-    teletext->queue = NULL;
-  }
-  g_mutex_unlock (teletext->queue_lock);
+  /* streaming has stopped, so neither end of the queue is in use */
+  g_atomic_int_set (&teletext->queue_head, 0);
+  g_atomic_int_set (&teletext->queue_tail, 0);
 
   teletext->in_timestamp = GST_CLOCK_TIME_NONE;
   teletext->in_duration = GST_CLOCK_TIME_NONE;
@@ -332,16 +866,65 @@ gst_teletextdec_set_property (GObject * object, guint prop_id,
 
   switch (prop_id) {
     case PROP_PAGENO:
+      /* the streaming thread shows the new page from the cache */
+      GST_OBJECT_LOCK (teletext);
       teletext->pageno = (gint) vbi_bin2bcd (g_value_get_int (value));
+      teletext->page_changed = TRUE;
+      GST_OBJECT_UNLOCK (teletext);
       break;
     case PROP_SUBNO:
+      GST_OBJECT_LOCK (teletext);
       teletext->subno = g_value_get_int (value);
+      teletext->page_changed = TRUE;
+      GST_OBJECT_UNLOCK (teletext);
       break;
     case PROP_SUBTITLES_MODE:
       teletext->subtitles_mode = g_value_get_boolean (value);
       break;
     case PROP_SUBS_TEMPLATE:
-      teletext->subtitles_template = g_value_dup_string (value);
+      gst_teletextdec_set_subtitles_template (teletext,
+          g_value_get_string (value));
+      break;
+    case PROP_MAX_PARITY_ERRORS:
+      teletext->max_parity_errors = g_value_get_int (value);
+      break;
+    case PROP_DEDUPLICATE:
+      teletext->deduplicate = g_value_get_boolean (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      teletext->stats_interval = g_value_get_uint (value);
+      break;
+    case PROP_EXPORT_THREADS:
+      teletext->export_threads = g_value_get_uint (value);
+      break;
+    case PROP_CACHE_FILE:
+      g_free (teletext->cache_file);
+      teletext->cache_file = g_value_dup_string (value);
+      break;
+    case PROP_CACHE_SAVE_INTERVAL:
+      teletext->cache_save_interval = g_value_get_uint (value);
+      break;
+    case PROP_SUBTITLES_CHANGE_ONLY:
+      teletext->subtitles_change_only = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_QUEUE_SIZE:
+      teletext->max_queue_size = g_value_get_uint (value);
+      break;
+    case PROP_LEAKY:
+      teletext->leaky = g_value_get_enum (value);
+      break;
+    case PROP_RENDERER:
+      teletext->renderer = g_value_get_enum (value);
+      break;
+    case PROP_PAGE_FILTER:
+      teletext->page_filter = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_CACHE_PAGES:
+      teletext->max_cache_pages = g_value_get_uint (value);
+      break;
+    case PROP_CACHE_PAGE_SET:
+      gst_teletextdec_set_cache_page_set (teletext,
+          g_value_get_string (value));
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -368,6 +951,52 @@ gst_teletextdec_get_property (GObject * object, guint prop_id,
     case PROP_SUBS_TEMPLATE:
       g_value_set_string (value, teletext->subtitles_template);
       break;
+    case PROP_MAX_PARITY_ERRORS:
+      g_value_set_int (value, teletext->max_parity_errors);
+      break;
+    case PROP_DEDUPLICATE:
+      g_value_set_boolean (value, teletext->deduplicate);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_teletextdec_get_stats (teletext));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, teletext->stats_interval);
+      break;
+    case PROP_EXPORT_THREADS:
+      g_value_set_uint (value, teletext->export_threads);
+      break;
+    case PROP_CACHE_FILE:
+      g_value_set_string (value, teletext->cache_file);
+      break;
+    case PROP_CACHE_SAVE_INTERVAL:
+      g_value_set_uint (value, teletext->cache_save_interval);
+      break;
+    case PROP_SUBTITLES_CHANGE_ONLY:
+      g_value_set_boolean (value, teletext->subtitles_change_only);
+      break;
+    case PROP_MAX_QUEUE_SIZE:
+      g_value_set_uint (value, teletext->max_queue_size);
+      break;
+    case PROP_LEAKY:
+      g_value_set_enum (value, teletext->leaky);
+      break;
+    case PROP_RENDERER:
+      g_value_set_enum (value, teletext->renderer);
+      break;
+    case PROP_PAGE_FILTER:
+      g_value_set_boolean (value, teletext->page_filter);
+      break;
+    case PROP_MAX_CACHE_PAGES:
+      g_value_set_uint (value, teletext->max_cache_pages);
+      break;
+    case PROP_CACHE_PAGE_SET:
+      g_value_set_string (value, teletext->cache_page_set);
+      break;
+    case PROP_CACHE_MEMORY:
+      g_value_set_uint64 (value, (guint64) ZVBI_SUBPAGE_SIZE *
+          g_atomic_int_get (&teletext->n_cached_subpages));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -383,23 +1012,47 @@ gst_teletextdec_sink_event (GstPad * pad, GstEvent * event)
   GST_DEBUG_OBJECT (teletext, "got event %s",
       gst_event_type_get_name (GST_EVENT_TYPE (event)));
 
+  /* keep events in order with the pages still being exported */
+  if (GST_EVENT_IS_SERIALIZED (event))
+    gst_teletextdec_drain_exports (teletext);
+
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_NEWSEGMENT:
-      /* maybe save and/or update the current segment (e.g. for output
-       * clipping) or convert the event into one in a different format
-       * (e.g. BYTES to TIME) or drop it and set a flag to send a newsegment
-       * event in a different format later */
-      ret = gst_pad_push_event (teletext->srcpad, event);
+    {
+      gboolean update;
+      gdouble rate, applied_rate;
+      GstFormat format;
+      gint64 start, stop, position;
+
+      /* keep the segment to send updates for skipped pages */
+      gst_event_parse_new_segment_full (event, &update, &rate, &applied_rate,
+          &format, &start, &stop, &position);
+      /* the held subtitles belong to the previous segment */
+      if (!update)
+        gst_teletextdec_push_held (teletext);
+      gst_segment_set_newsegment_full (&teletext->segment, update, rate,
+          applied_rate, format, start, stop, position);
+      ret = gst_pad_event_default (pad, event);
+      /* a sparse stream advanced without input, so a newly selected page
+       * is not shown by the next buffer anytime soon */
+      if (update && teletext->page_changed && teletext->decoder != NULL)
+        gst_teletextdec_show_new_page (teletext);
       break;
+    }
     case GST_EVENT_EOS:
       /* end-of-stream, we should close down all stream leftovers here */
+      gst_teletextdec_push_held (teletext);
+      gst_teletextdec_save_cache (teletext, TRUE);
       gst_teletextdec_zvbi_clear (teletext);
-      ret = gst_pad_push_event (teletext->srcpad, event);
+      ret = gst_pad_event_default (pad, event);
       break;
     case GST_EVENT_FLUSH_STOP:
       gst_teletextdec_zvbi_clear (teletext);
       gst_teletextdec_zvbi_init (teletext);
-      ret = gst_pad_push_event (teletext->srcpad, event);
+      teletext->export_ret = GST_FLOW_OK;
+      teletext->snapshot_served = FALSE;
+      gst_segment_init (&teletext->segment, GST_FORMAT_UNDEFINED);
+      ret = gst_pad_event_default (pad, event);
       break;
     default:
       ret = gst_pad_event_default (pad, event);
@@ -421,7 +1074,27 @@ gst_teletextdec_change_state (GstElement * element, GstStateChange transition)
 
   switch (transition) {
     case GST_STATE_CHANGE_READY_TO_PAUSED:
+      memset (&teletext->stats, 0, sizeof (GstTeletextStats));
+      g_mutex_lock (teletext->stats_lock);
+      memset (&teletext->published_stats, 0, sizeof (GstTeletextStats));
+      g_mutex_unlock (teletext->stats_lock);
+      teletext->last_stats_post = GST_CLOCK_TIME_NONE;
       gst_teletextdec_zvbi_init (teletext);
+      gst_teletextdec_load_cache (teletext);
+      teletext->last_cache_save = GST_CLOCK_TIME_NONE;
+      /* the page set before starting is shown as it arrives */
+      GST_OBJECT_LOCK (teletext);
+      teletext->page_changed = FALSE;
+      GST_OBJECT_UNLOCK (teletext);
+
+      teletext->export_seqnum = 0;
+      teletext->export_push_seqnum = 0;
+      teletext->export_ret = GST_FLOW_OK;
+      if (teletext->export_threads > 0) {
+        teletext->export_pool =
+            g_thread_pool_new (gst_teletextdec_export_func, teletext,
+            teletext->export_threads, FALSE, NULL);
+      }
       break;
     default:
       break;
@@ -433,7 +1106,15 @@ gst_teletextdec_change_state (GstElement * element, GstStateChange transition)
 
   switch (transition) {
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_teletextdec_save_cache (teletext, TRUE);
+      g_free (teletext->cache_image);
+      teletext->cache_image = NULL;
       gst_teletextdec_zvbi_clear (teletext);
+      gst_teletextdec_drop_snapshot (teletext);
+      if (teletext->export_pool != NULL) {
+        g_thread_pool_free (teletext->export_pool, FALSE, TRUE);
+        teletext->export_pool = NULL;
+      }
       break;
     default:
       break;
@@ -475,8 +1156,16 @@ gst_teletextdec_sink_setcaps (GstPad * pad, GstCaps * caps)
 
 accept_caps:
   {
+    gboolean res = TRUE;
+    GList *l;
+
+    for (l = teletext->outputs; l != NULL; l = l->next) {
+      GstTeletextOutput *output = (GstTeletextOutput *) l->data;
+
+      res &= gst_teletextdec_push_preroll_buffer (teletext, output->pad);
+    }
     gst_object_unref (teletext);
-    return gst_teletextdec_push_preroll_buffer (teletext);
+    return res;
   }
 
 refuse_caps:
@@ -493,10 +1182,12 @@ static gboolean
 gst_teletextdec_src_set_caps (GstPad * pad, GstCaps * caps)
 {
   GstTeletextDec *teletext;
+  GstTeletextOutput *output;
   GstStructure *structure = NULL;
   const gchar *mimetype;
 
   teletext = GST_TELETEXTDEC (gst_pad_get_parent (pad));
+  output = (GstTeletextOutput *) gst_pad_get_element_private (pad);
   GST_DEBUG_OBJECT (teletext, "Linking teletext source pad");
 
   if (gst_caps_is_empty (caps)) {
@@ -511,18 +1202,25 @@ gst_teletextdec_src_set_caps (GstPad * pad, GstCaps * caps)
   structure = gst_caps_get_structure (caps, 0);
   mimetype = gst_structure_get_name (structure);
 
-  if (g_strcmp0 (mimetype, "video/x-raw-rgb") == 0) {
-    teletext->output_format = GST_TELETEXTDEC_OUTPUT_FORMAT_RGBA;
-    GST_DEBUG_OBJECT (teletext, "Selected RGBA output format");
+  if (g_str_has_prefix (mimetype, "video/")) {
+    if (!gst_video_format_parse_caps (caps, &output->video_format,
+            &output->width, &output->height))
+      goto refuse_caps;
+    gst_caps_replace (&output->video_caps, caps);
+    output->output_format = GST_TELETEXTDEC_OUTPUT_FORMAT_RGBA;
+    GST_DEBUG_OBJECT (teletext, "Selected video output format %d, %dx%d",
+        output->video_format, output->width, output->height);
   } else if (g_strcmp0 (mimetype, "text/html") == 0) {
-    teletext->output_format = GST_TELETEXTDEC_OUTPUT_FORMAT_HTML;
+    output->output_format = GST_TELETEXTDEC_OUTPUT_FORMAT_HTML;
     GST_DEBUG_OBJECT (teletext, "Selected HTML output format");
   } else if (g_strcmp0 (mimetype, "text/plain") == 0) {
-    teletext->output_format = GST_TELETEXTDEC_OUTPUT_FORMAT_TEXT;
+    output->output_format = GST_TELETEXTDEC_OUTPUT_FORMAT_TEXT;
     GST_DEBUG_OBJECT (teletext, "Selected text output format");
   } else
     goto refuse_caps;
 
+  gst_teletextdec_pool_set_caps (output->pool, caps);
+
   gst_object_unref (teletext);
   return TRUE;
 
@@ -534,6 +1232,143 @@ refuse_caps:
   }
 }
 
+static GstPad *
+gst_teletextdec_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name)
+{
+  GstTeletextDec *teletext = GST_TELETEXTDEC (element);
+  GstTeletextOutput *output;
+  GstPad *pad;
+  gint pageno;
+
+  if (name == NULL || sscanf (name, "src_%d", &pageno) != 1)
+    goto wrong_name;
+  if (pageno < 100 || pageno > 899)
+    goto wrong_name;
+
+  GST_DEBUG_OBJECT (teletext, "Requested pad %s for page %03d", name, pageno);
+
+  pad = gst_pad_new_from_template (templ, name);
+  gst_pad_set_setcaps_function (pad,
+      GST_DEBUG_FUNCPTR (gst_teletextdec_src_set_caps));
+
+  output = g_new0 (GstTeletextOutput, 1);
+  output->pad = pad;
+  output->pageno = (gint) vbi_bin2bcd (pageno);
+  output->subno = -1;
+  output->output_format = GST_TELETEXTDEC_OUTPUT_FORMAT_RGBA;
+  output->pool = gst_teletextdec_pool_new ();
+  output->lock = g_mutex_new ();
+  gst_pad_set_element_private (pad, output);
+
+  gst_pad_set_active (pad, TRUE);
+  if (!gst_element_add_pad (element, pad))
+    goto add_failed;
+
+  /* the outputs are walked from the streaming thread */
+  GST_PAD_STREAM_LOCK (teletext->sinkpad);
+  teletext->outputs = g_list_append (teletext->outputs, output);
+  GST_PAD_STREAM_UNLOCK (teletext->sinkpad);
+
+  return pad;
+
+wrong_name:
+  {
+    GST_WARNING_OBJECT (teletext, "Pad name %s does not contain a page "
+        "number between 100 and 899", GST_STR_NULL (name));
+    return NULL;
+  }
+
+add_failed:
+  {
+    GST_WARNING_OBJECT (teletext, "Could not add pad %s", name);
+    gst_teletextdec_output_free (output);
+    gst_object_unref (pad);
+    return NULL;
+  }
+}
+
+static void
+gst_teletextdec_release_pad (GstElement * element, GstPad * pad)
+{
+  GstTeletextDec *teletext = GST_TELETEXTDEC (element);
+  GstTeletextOutput *output;
+
+  output = (GstTeletextOutput *) gst_pad_get_element_private (pad);
+
+  GST_DEBUG_OBJECT (teletext, "Releasing pad %s", GST_PAD_NAME (pad));
+
+  GST_PAD_STREAM_LOCK (teletext->sinkpad);
+  gst_teletextdec_drain_exports (teletext);
+  teletext->outputs = g_list_remove (teletext->outputs, output);
+  GST_PAD_STREAM_UNLOCK (teletext->sinkpad);
+
+  gst_pad_set_element_private (pad, NULL);
+  gst_teletextdec_output_free (output);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+}
+
+/* Drops what was kept of the last page pushed on @output */
+static void
+gst_teletextdec_output_reset (GstTeletextOutput * output)
+{
+  if (output->last_frame != NULL) {
+    gst_buffer_unref (output->last_frame);
+    output->last_frame = NULL;
+  }
+  g_free (output->last_page);
+  output->last_page = NULL;
+  output->has_hash = FALSE;
+  if (output->video_caps != NULL) {
+    gst_caps_unref (output->video_caps);
+    output->video_caps = NULL;
+  }
+  gst_teletextdec_pool_set_caps (output->pool, NULL);
+  g_free (output->canvas);
+  output->canvas = NULL;
+  output->canvas_size = 0;
+  g_free (output->xmap);
+  output->xmap = NULL;
+  if (output->held != NULL) {
+    gst_buffer_unref (output->held);
+    output->held = NULL;
+  }
+}
+
+static void
+gst_teletextdec_output_free (GstTeletextOutput * output)
+{
+  gst_teletextdec_output_reset (output);
+  gst_teletextdec_pool_close (output->pool);
+  g_mutex_free (output->lock);
+  if (output->text != NULL)
+    g_string_free (output->text, TRUE);
+  if (output->glyphs != NULL)
+    g_hash_table_destroy (output->glyphs);
+  g_free (output->glyph_page);
+  g_free (output);
+}
+
+/* Whether @output shows page @pgno.@subno, both in BCD */
+static gboolean
+gst_teletextdec_output_wants_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_pgno pgno, vbi_subno subno)
+{
+  gint want_pgno, want_subno;
+
+  if (output->pad == teletext->srcpad) {
+    want_pgno = teletext->pageno;
+    want_subno = teletext->subno;
+  } else {
+    want_pgno = output->pageno;
+    want_subno = output->subno;
+  }
+
+  return pgno == want_pgno && (want_subno == -1 || subno == want_subno);
+}
+
 static void
 gst_teletextdec_reset_frame (GstTeletextDec * teletext)
 {
@@ -542,6 +1377,9 @@ gst_teletextdec_reset_frame (GstTeletextDec * teletext)
   teletext->frame->last_field = 0;
   teletext->frame->last_field_line = 0;
   teletext->frame->last_frame_line = 0;
+  teletext->frame->timestamp = GST_CLOCK_TIME_NONE;
+  teletext->frame->parity_errors = 0;
+  teletext->frame->dropped_lines = 0;
 }
 
 static void
@@ -552,51 +1390,206 @@ gst_teletextdec_process_pes_buffer (GstTeletextDec * teletext, GstBuffer * buf)
   return;
 }
 
+/* Whether page @pgno is shown on any pad */
+static gboolean
+gst_teletextdec_page_shown (GstTeletextDec * teletext, vbi_pgno pgno)
+{
+  GList *l;
+
+  for (l = teletext->outputs; l != NULL; l = l->next) {
+    GstTeletextOutput *output = (GstTeletextOutput *) l->data;
+
+    if (pgno == (output->pad == teletext->srcpad ?
+            teletext->pageno : output->pageno))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Whether the decoder gets to see page @pgno. Besides the pages shown
+ * these are the pages with hex numbers, which carry the navigation and
+ * magazine organisation tables, and, unless page-filter is set, the pages
+ * of cache-page-set up to max-cache-pages of them. */
+static gboolean
+gst_teletextdec_page_kept (GstTeletextDec * teletext, vbi_pgno pgno)
+{
+  gint i = pgno - 0x100;
+
+  if (gst_teletextdec_page_shown (teletext, pgno))
+    return TRUE;
+  if ((pgno & 0xF) > 9 || (pgno & 0xF0) > 0x90)
+    return (pgno & 0xFF) != 0xFF;
+  if (teletext->page_filter)
+    return FALSE;
+  if (teletext->pages_admitted[i / 8] & (1 << (i % 8)))
+    return TRUE;
+
+  if (teletext->cache_page_set != NULL &&
+      !(teletext->cache_pages[i / 8] & (1 << (i % 8))))
+    return FALSE;
+  if (teletext->max_cache_pages > 0 &&
+      teletext->n_pages_admitted >= teletext->max_cache_pages)
+    return FALSE;
+
+  teletext->pages_admitted[i / 8] |= 1 << (i % 8);
+  teletext->n_pages_admitted++;
+  return TRUE;
+}
+
+/* Copies the lines of @sliced the decoder needs for the pages kept into
+ * teletext->filtered and returns how many there are. Those are the packets
+ * of the pages kept, the magazine wide packets 29 to 31 and the page
+ * headers, as a header ends the page sent before in its magazine. Headers
+ * of other pages become headers of page xFF, which the decoder does not
+ * store. */
+static gint
+gst_teletextdec_filter_lines (GstTeletextDec * teletext,
+    const vbi_sliced * sliced, gint n_lines)
+{
+  vbi_sliced *dest;
+  gint i, n = 0;
+
+  if (G_UNLIKELY (teletext->filtered_size < n_lines)) {
+    teletext->filtered = g_renew (vbi_sliced, teletext->filtered, n_lines);
+    teletext->filtered_size = n_lines;
+  }
+  dest = teletext->filtered;
+
+  for (i = 0; i < n_lines; i++) {
+    const vbi_sliced *s = &sliced[i];
+    gint mrag, magazine, packet, units, tens;
+
+    if (!(s->id & VBI_SLICED_TELETEXT_B)) {
+      dest[n++] = *s;
+      continue;
+    }
+
+    mrag = vbi_unham16p (s->data);
+    if (mrag < 0)
+      goto drop;
+    magazine = mrag & 7;
+    packet = mrag >> 3;
+
+    if (packet == 0) {
+      units = vbi_unham8 (s->data[2]);
+      tens = vbi_unham8 (s->data[3]);
+      if (units < 0 || tens < 0) {
+        teletext->magazine_kept[magazine] = FALSE;
+        goto drop;
+      }
+      teletext->magazine_kept[magazine] =
+          gst_teletextdec_page_kept (teletext,
+          (magazine ? magazine : 8) << 8 | tens << 4 | units);
+
+      dest[n] = *s;
+      if (!teletext->magazine_kept[magazine])
+        dest[n].data[2] = dest[n].data[3] = vbi_ham8 (0xF);
+      n++;
+    } else if (packet >= 29 || teletext->magazine_kept[magazine]) {
+      dest[n++] = *s;
+    } else {
+      goto drop;
+    }
+    continue;
+
+  drop:
+    teletext->stats.lines_filtered++;
+  }
+
+  return n;
+}
+
+/* Hands a frame to the decoder. vbi_decode() takes frames outside of the
+ * expected spacing as dropped frames and starts a resynchronization, which
+ * ends up resetting the page cache as if the channel had changed. Jitter
+ * and small gaps in the timestamps are common in captures, so short gaps
+ * are filled with empty frames and time going backwards is clamped;
+ * longer jumps are left to the decoder as real discontinuities. */
+static void
+gst_teletextdec_decode_frame (GstTeletextDec * teletext, vbi_sliced * sliced,
+    gint n_lines, gdouble sample_time)
+{
+  gdouble delta = sample_time - teletext->last_ts;
+
+  if (teletext->page_filter || teletext->max_cache_pages > 0 ||
+      teletext->cache_page_set != NULL) {
+    n_lines = gst_teletextdec_filter_lines (teletext, sliced, n_lines);
+    sliced = teletext->filtered;
+  }
+
+  if (teletext->last_ts > 0) {
+    if (delta < MIN_FRAME_DELTA && delta > -MAX_FILLED_GAP) {
+      sample_time = teletext->last_ts + FRAME_PERIOD;
+      teletext->stats.resyncs_avoided++;
+    } else if (delta > MAX_FRAME_DELTA && delta <= MAX_FILLED_GAP) {
+      guint n = (guint) (delta / MAX_FRAME_DELTA) + 1;
+      guint i;
+
+      GST_LOG_OBJECT (teletext, "Filling a gap of %.3f s with %u frames",
+          delta, n - 1);
+      for (i = 1; i < n; i++)
+        vbi_decode (teletext->decoder, sliced, 0,
+            teletext->last_ts + i * (delta / n));
+      teletext->stats.resyncs_avoided++;
+    }
+  }
+
+  vbi_decode (teletext->decoder, sliced, n_lines, sample_time);
+  teletext->last_ts = sample_time;
+  teletext->stats.frames_decoded++;
+}
+
 static void
 gst_teletextdec_process_telx_buffer (GstTeletextDec * teletext, GstBuffer * buf)
 {
   guint8 *data = GST_BUFFER_DATA (buf);
   const gint size = GST_BUFFER_SIZE (buf);
+  GstTeletextFrame *frame = teletext->frame;
+  GstClockTime timestamp = GST_BUFFER_TIMESTAMP (buf);
   guint offset = 1;
+  guint n_frames = 0;
   gint res;
 
   teletext->in_timestamp = GST_BUFFER_TIMESTAMP (buf);
   teletext->in_duration = GST_BUFFER_DURATION (buf);
 
-  if (teletext->frame == NULL) {
-    gst_teletextdec_reset_frame (teletext);
+  /* frames started in this buffer are timed from its timestamp, one frame
+   * period apart */
+  if (frame->current_slice == frame->sliced_begin &&
+      frame->last_frame_line == 0) {
+    frame->timestamp = timestamp;
+    n_frames++;
   }
 
   while (offset < size) {
     res =
-        gst_teletextdec_extract_data_units (teletext, teletext->frame, data,
+        gst_teletextdec_extract_data_units (teletext, frame, data,
         &offset, size);
 
     if (res == VBI_NEW_FRAME) {
       /* We have a new frame, it's time to feed the decoder */
-      vbi_sliced *s;
       gint n_lines;
+      gdouble sample_time;
+
+      n_lines = frame->current_slice - frame->sliced_begin;
+      GST_LOG_OBJECT (teletext, "Completed frame, decoding new %d lines, "
+          "dropped %u lines, %u parity errors", n_lines,
+          frame->dropped_lines, frame->parity_errors);
+      /* without timestamps, keep the decoder's clock going at the frame
+       * rate */
+      if (GST_CLOCK_TIME_IS_VALID (frame->timestamp))
+        sample_time = (gdouble) frame->timestamp / GST_SECOND;
+      else
+        sample_time = teletext->last_ts + FRAME_PERIOD;
+      gst_teletextdec_decode_frame (teletext, frame->sliced_begin, n_lines,
+          sample_time);
 
-      n_lines = teletext->frame->current_slice - teletext->frame->sliced_begin;
-      GST_LOG_OBJECT (teletext, "Completed frame, decoding new %d lines",
-          n_lines);
-      s = g_memdup (teletext->frame->sliced_begin,
-          n_lines * sizeof (vbi_sliced));
-      vbi_decode (teletext->decoder, s, n_lines, teletext->last_ts);
-      /* From vbi_decode():
-       * timestamp shall advance by 1/30 to 1/25 seconds whenever calling this
-       * function. Failure to do so will be interpreted as frame dropping, which
-       * starts a resynchronization cycle, eventually a channel switch may be assumed
-       * which resets even more decoder state. So even if a frame did not contain
-       * any useful data this function must be called, with lines set to zero.
-       */
-      teletext->last_ts += 0.04;
-
-      g_free (s);
       gst_teletextdec_reset_frame (teletext);
-    } else if (res == VBI_ERROR) {
-      gst_teletextdec_reset_frame (teletext);
-      return;
+      if (GST_CLOCK_TIME_IS_VALID (timestamp))
+        frame->timestamp = timestamp +
+            gst_util_uint64_scale (n_frames, GST_SECOND, 25);
+      n_frames++;
     }
   }
   return;
@@ -611,13 +1604,13 @@ gst_teletextdec_convert (vbi_dvb_demux * dx,
   GST_DEBUG_OBJECT (teletext, "Converting %u lines to decode", n_lines);
 
   gdouble sample_time;
-  vbi_sliced *s;
 
   sample_time = pts * (1 / 90000.0);
 
-  s = g_memdup (sliced, n_lines * sizeof (vbi_sliced));
-  vbi_decode (teletext->decoder, s, n_lines, sample_time);
-  g_free (s);
+  /* vbi_decode() only reads the sliced lines, so feed the demuxer's buffer
+   * directly instead of copying it */
+  gst_teletextdec_decode_frame (teletext, (vbi_sliced *) sliced, n_lines,
+      sample_time);
 
   return GST_FLOW_OK;
 }
@@ -625,9 +1618,11 @@ gst_teletextdec_convert (vbi_dvb_demux * dx,
 static void
 gst_teletextdec_event_handler (vbi_event * ev, void *user_data)
 {
-  page_info *pi;
+  GstTeletextPageInfo *pi;
+  guint head, tail, i;
   vbi_pgno pgno;
   vbi_subno subno;
+  GList *l;
 
   GstTeletextDec *teletext = GST_TELETEXTDEC (user_data);
 
@@ -635,22 +1630,91 @@ gst_teletextdec_event_handler (vbi_event * ev, void *user_data)
     case VBI_EVENT_TTX_PAGE:
       pgno = ev->ev.ttx_page.pgno;
       subno = ev->ev.ttx_page.subno;
+      teletext->stats.pages_received++;
+      if (pgno >= 0x100 && pgno <= 0x8FF) {
+        guint8 *subpages = teletext->cached_subpages[pgno - 0x100];
+        guint bit = subno & 0x7F;
+
+        teletext->pages_dirty[(pgno - 0x100) / 8] |= 1 << ((pgno - 0x100) % 8);
+        if (!(subpages[bit / 8] & (1 << (bit % 8)))) {
+          subpages[bit / 8] |= 1 << (bit % 8);
+          g_atomic_int_inc (&teletext->n_cached_subpages);
+        }
+      }
 
-      if (pgno != teletext->pageno
-          || (teletext->subno != -1 && subno != teletext->subno))
+      for (l = teletext->outputs; l != NULL; l = l->next) {
+        if (gst_teletextdec_output_wants_page (teletext,
+                (GstTeletextOutput *) l->data, pgno, subno))
+          break;
+      }
+      if (l == NULL)
         return;
 
       GST_DEBUG_OBJECT (teletext, "Received teletext page %03d.%02d",
           (gint) vbi_bcd2dec (pgno), (gint) vbi_bcd2dec (subno));
 
-      pi = g_new (page_info, 1);
+      /* the page is fetched from the zvbi cache when it is rendered, so
+       * a queued entry already shows this version */
+      head = g_atomic_int_get (&teletext->queue_head);
+      tail = teletext->queue_tail;
+      for (i = head; i != tail; i++) {
+        pi = &teletext->queue[i & (PAGE_QUEUE_SIZE - 1)];
+        if (pi->pgno == pgno && pi->subno == subno) {
+          GST_LOG_OBJECT (teletext, "Page %03d already queued",
+              (gint) vbi_bcd2dec (pgno));
+          return;
+        }
+      }
+
+      /* the queue is drained by this thread once the decoder returns,
+       * so a full queue can not block and the new page is refused when
+       * it is not leaky */
+      if (G_UNLIKELY (tail - head >= teletext->max_queue_size)) {
+        teletext->stats.pages_dropped++;
+        if (teletext->leaky == GST_TELETEXTDEC_LEAKY_NO) {
+          GST_WARNING_OBJECT (teletext, "Page queue full, dropping page %03d",
+              (gint) vbi_bcd2dec (pgno));
+          return;
+        } else if (teletext->leaky == GST_TELETEXTDEC_LEAKY_UPSTREAM) {
+          GST_DEBUG_OBJECT (teletext, "Page queue full, dropping page %03d",
+              (gint) vbi_bcd2dec (pgno));
+          return;
+        }
+        pi = &teletext->queue[head & (PAGE_QUEUE_SIZE - 1)];
+        GST_DEBUG_OBJECT (teletext, "Page queue full, dropping page %03d",
+            (gint) vbi_bcd2dec (pi->pgno));
+        g_atomic_int_set (&teletext->queue_head, head + 1);
+      }
+
+      pi = &teletext->queue[tail & (PAGE_QUEUE_SIZE - 1)];
       pi->pgno = pgno;
       pi->subno = subno;
+      pi->timestamp = teletext->in_timestamp;
+      pi->duration = teletext->in_duration;
+      /* publish the slot only once it is filled in */
+      g_atomic_int_set (&teletext->queue_tail, tail + 1);
+      break;
+    case VBI_EVENT_NETWORK:
+    {
+      guint cni = ev->ev.network.cni_8301;
+
+      if (cni == 0)
+        cni = ev->ev.network.cni_8302;
+      if (cni == 0)
+        cni = ev->ev.network.cni_vps;
+      if (cni == 0)
+        break;
 
-      g_mutex_lock (teletext->queue_lock);
-      g_queue_push_tail (teletext->queue, pi);
-      g_mutex_unlock (teletext->queue_lock);
+      teletext->network_cni = cni;
+      /* the cached pages belong to another network */
+      if (teletext->snapshot != NULL && teletext->snapshot_cni != 0 &&
+          teletext->snapshot_cni != cni) {
+        GST_INFO_OBJECT (teletext, "Network changed to %04x, dropping the "
+            "page cache of %04x", cni, teletext->snapshot_cni);
+        gst_teletextdec_drop_snapshot (teletext);
+      }
       break;
+    }
     case VBI_EVENT_CAPTION:
       /* TODO: Handle subtitles in caption teletext pages */
       GST_DEBUG_OBJECT (teletext, "Received caption page. Not implemented");
@@ -661,258 +1725,1991 @@ gst_teletextdec_event_handler (vbi_event * ev, void *user_data)
   return;
 }
 
-/* this function does the actual processing
- */
-static GstFlowReturn
-gst_teletextdec_chain (GstPad * pad, GstBuffer * buf)
-{
-  GstTeletextDec *teletext = GST_TELETEXTDEC (GST_PAD_PARENT (pad));
-  GstFlowReturn ret = GST_FLOW_OK;
+/* upper bounds of the export time histogram buckets in microseconds, the
+ * last bucket takes everything slower */
+static const guint
+    export_bucket_bounds[GST_TELETEXTDEC_N_EXPORT_BUCKETS - 1] = {
+  50, 100, 200, 500, 1000, 2000, 5000
+};
 
-  teletext->in_timestamp = GST_BUFFER_TIMESTAMP (buf);
-  teletext->in_duration = GST_BUFFER_DURATION (buf);
+static const gchar *output_format_names[GST_TELETEXTDEC_N_OUTPUT_FORMATS] = {
+  "rgba", "text", "html", "subtitles"
+};
 
-  teletext->process_buf_func (teletext, buf);
-  gst_buffer_unref (buf);
+static void
+gst_teletextdec_record_export (GstTeletextDec * teletext,
+    GstTeletextOutputFormat format, GstClockTime duration)
+{
+  guint64 usecs = duration / GST_USECOND;
+  guint i;
 
-  g_mutex_lock (teletext->queue_lock);
-  if (!g_queue_is_empty (teletext->queue)) {
-    ret = gst_teletextdec_push_page (teletext);
-    if (ret != GST_FLOW_OK)
-      goto error;
+  for (i = 0; i < G_N_ELEMENTS (export_bucket_bounds); i++) {
+    if (usecs < export_bucket_bounds[i])
+      break;
+  }
+  g_mutex_lock (teletext->stats_lock);
+  teletext->published_stats.export_time[format][i]++;
+  g_mutex_unlock (teletext->stats_lock);
+}
+
+/* Makes the counters of the streaming thread visible to the stats
+ * property. The export counters are only kept in published_stats. */
+static void
+gst_teletextdec_publish_stats (GstTeletextDec * teletext)
+{
+  GstTeletextStats *published = &teletext->published_stats;
+  GstTeletextStats *stats = &teletext->stats;
+
+  g_mutex_lock (teletext->stats_lock);
+  published->units_parsed = stats->units_parsed;
+  published->units_bad_length = stats->units_bad_length;
+  published->units_bad_line = stats->units_bad_line;
+  published->units_no_slice = stats->units_no_slice;
+  published->units_parity = stats->units_parity;
+  published->bytes_skipped = stats->bytes_skipped;
+  published->frames_decoded = stats->frames_decoded;
+  published->lines_filtered = stats->lines_filtered;
+  published->resyncs_avoided = stats->resyncs_avoided;
+  published->pages_received = stats->pages_received;
+  published->pages_dropped = stats->pages_dropped;
+  g_mutex_unlock (teletext->stats_lock);
+}
+
+static GstStructure *
+gst_teletextdec_get_stats (GstTeletextDec * teletext)
+{
+  GstTeletextStats copy;
+  GstTeletextStats *stats = &copy;
+  GstStructure *structure;
+  GValue array = { 0, };
+  GValue value = { 0, };
+  guint i, j;
+
+  g_mutex_lock (teletext->stats_lock);
+  copy = teletext->published_stats;
+  g_mutex_unlock (teletext->stats_lock);
+
+  structure = gst_structure_new ("teletextdec-stats",
+      "units-parsed", G_TYPE_UINT64, stats->units_parsed,
+      "units-dropped-bad-length", G_TYPE_UINT64, stats->units_bad_length,
+      "units-dropped-bad-line", G_TYPE_UINT64, stats->units_bad_line,
+      "units-dropped-no-slice", G_TYPE_UINT64, stats->units_no_slice,
+      "units-dropped-parity", G_TYPE_UINT64, stats->units_parity,
+      "bytes-skipped", G_TYPE_UINT64, stats->bytes_skipped,
+      "frames-decoded", G_TYPE_UINT64, stats->frames_decoded,
+      "lines-filtered", G_TYPE_UINT64, stats->lines_filtered,
+      "resyncs-avoided", G_TYPE_UINT64, stats->resyncs_avoided,
+      "pages-received", G_TYPE_UINT64, stats->pages_received,
+      "pages-dropped", G_TYPE_UINT64, stats->pages_dropped,
+      "pages-pushed", G_TYPE_UINT64, stats->pages_pushed,
+      "queue-depth", G_TYPE_UINT,
+      (guint) (g_atomic_int_get (&teletext->queue_tail) -
+          g_atomic_int_get (&teletext->queue_head)), NULL);
+
+  /* one array of bucket counts per format, and the bucket bounds */
+  g_value_init (&value, G_TYPE_UINT);
+  g_value_init (&array, GST_TYPE_ARRAY);
+  for (i = 0; i < G_N_ELEMENTS (export_bucket_bounds); i++) {
+    g_value_set_uint (&value, export_bucket_bounds[i]);
+    gst_value_array_append_value (&array, &value);
+  }
+  gst_structure_set_value (structure, "export-bucket-bounds-us", &array);
+  g_value_unset (&array);
+  g_value_unset (&value);
+
+  g_value_init (&value, G_TYPE_UINT64);
+  for (i = 0; i < GST_TELETEXTDEC_N_OUTPUT_FORMATS; i++) {
+    gchar *name;
+
+    g_value_init (&array, GST_TYPE_ARRAY);
+    for (j = 0; j < GST_TELETEXTDEC_N_EXPORT_BUCKETS; j++) {
+      g_value_set_uint64 (&value, stats->export_time[i][j]);
+      gst_value_array_append_value (&array, &value);
+    }
+    name = g_strdup_printf ("export-%s", output_format_names[i]);
+    gst_structure_set_value (structure, name, &array);
+    g_free (name);
+    g_value_unset (&array);
+  }
+  g_value_unset (&value);
+
+  return structure;
+}
+
+static void
+gst_teletextdec_post_stats (GstTeletextDec * teletext)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+
+  if (GST_CLOCK_TIME_IS_VALID (teletext->last_stats_post) &&
+      now - teletext->last_stats_post <
+      teletext->stats_interval * GST_MSECOND)
+    return;
+  teletext->last_stats_post = now;
+
+  gst_element_post_message (GST_ELEMENT (teletext),
+      gst_message_new_element (GST_OBJECT (teletext),
+          gst_teletextdec_get_stats (teletext)));
+}
+
+/* Shows what has to be shown before decoding more input: the cached pages
+ * and a newly selected page */
+static GstFlowReturn
+gst_teletextdec_begin_input (GstTeletextDec * teletext)
+{
+  GstFlowReturn ret;
+
+  /* show the cached pages until they are transmitted again */
+  if (G_UNLIKELY (teletext->snapshot != NULL && !teletext->snapshot_served)) {
+    ret = gst_teletextdec_serve_snapshot (teletext);
+    if (ret != GST_FLOW_OK)
+      return ret;
+  }
+
+  if (G_UNLIKELY (teletext->page_changed)) {
+    ret = gst_teletextdec_show_new_page (teletext);
+    if (ret != GST_FLOW_OK)
+      return ret;
+  }
+
+  return GST_FLOW_OK;
+}
+
+/* Whether any of the pads is linked */
+static gboolean
+gst_teletextdec_any_linked (GstTeletextDec * teletext)
+{
+  GList *l;
+
+  for (l = teletext->outputs; l != NULL; l = l->next) {
+    if (gst_pad_is_linked (((GstTeletextOutput *) l->data)->pad))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Pushes the pages received from the input decoded since the last call */
+static GstFlowReturn
+gst_teletextdec_end_input (GstTeletextDec * teletext)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  gst_teletextdec_publish_stats (teletext);
+
+  /* render everything received, so that no latency builds up */
+  while (g_atomic_int_get (&teletext->queue_tail) != teletext->queue_head) {
+    ret = gst_teletextdec_push_page (teletext);
+    if (ret != GST_FLOW_OK)
+      return ret;
   }
-  g_mutex_unlock (teletext->queue_lock);
 
-  return ret;
+  if (teletext->cache_file != NULL && teletext->cache_save_interval > 0) {
+    GstClockTime now = gst_util_get_timestamp ();
+
+    if (!GST_CLOCK_TIME_IS_VALID (teletext->last_cache_save)) {
+      teletext->last_cache_save = now;
+    } else if (now - teletext->last_cache_save >=
+        teletext->cache_save_interval * GST_SECOND) {
+      gst_teletextdec_save_cache (teletext, FALSE);
+      teletext->last_cache_save = now;
+    }
+  }
+
+  if (teletext->stats_interval > 0)
+    gst_teletextdec_post_stats (teletext);
+
+  /* an unlinked pad only fails the stream if no other pad is linked */
+  if (!gst_teletextdec_any_linked (teletext))
+    ret = GST_FLOW_NOT_LINKED;
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_teletextdec_input_error (GstTeletextDec * teletext, GstFlowReturn ret)
+{
+  if (GST_FLOW_IS_FATAL (ret)) {
+    GST_ELEMENT_ERROR (teletext, STREAM, FAILED,
+        ("Internal data stream error."),
+        ("stream stopped, reason %s", gst_flow_get_name (ret)));
+    gst_pad_event_default (teletext->sinkpad, gst_event_new_eos ());
+  }
+  return ret;
+}
+
+/* this function does the actual processing
+ */
+static GstFlowReturn
+gst_teletextdec_chain (GstPad * pad, GstBuffer * buf)
+{
+  GstTeletextDec *teletext = GST_TELETEXTDEC (GST_PAD_PARENT (pad));
+  GstFlowReturn ret;
+
+  teletext->in_timestamp = GST_BUFFER_TIMESTAMP (buf);
+  teletext->in_duration = GST_BUFFER_DURATION (buf);
+
+  ret = gst_teletextdec_begin_input (teletext);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (buf);
+    return gst_teletextdec_input_error (teletext, ret);
+  }
+
+  teletext->process_buf_func (teletext, buf);
+  gst_buffer_unref (buf);
+
+  ret = gst_teletextdec_end_input (teletext);
+  if (ret != GST_FLOW_OK)
+    return gst_teletextdec_input_error (teletext, ret);
+
+  return ret;
+}
+
+/* Decodes all buffers of @list before pushing the pages received, so that
+ * bursts of small packets from a demuxer are handled in one go. A group
+ * of several buffers is one packet split up. */
+static GstFlowReturn
+gst_teletextdec_chain_list (GstPad * pad, GstBufferList * list)
+{
+  GstTeletextDec *teletext = GST_TELETEXTDEC (GST_PAD_PARENT (pad));
+  GstBufferListIterator *it;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gboolean begun = FALSE;
+
+  it = gst_buffer_list_iterate (list);
+  while (gst_buffer_list_iterator_next_group (it)) {
+    GstBuffer *buf;
+
+    if (gst_buffer_list_iterator_n_buffers (it) == 0)
+      continue;
+    if (gst_buffer_list_iterator_n_buffers (it) == 1)
+      buf = gst_buffer_ref (gst_buffer_list_iterator_next (it));
+    else
+      buf = gst_buffer_list_iterator_merge_group (it);
+
+    teletext->in_timestamp = GST_BUFFER_TIMESTAMP (buf);
+    teletext->in_duration = GST_BUFFER_DURATION (buf);
+
+    if (!begun) {
+      ret = gst_teletextdec_begin_input (teletext);
+      if (ret != GST_FLOW_OK) {
+        gst_buffer_unref (buf);
+        break;
+      }
+      begun = TRUE;
+    }
+
+    teletext->process_buf_func (teletext, buf);
+    gst_buffer_unref (buf);
+  }
+  gst_buffer_list_iterator_free (it);
+  gst_buffer_list_unref (list);
+
+  if (ret == GST_FLOW_OK && begun)
+    ret = gst_teletextdec_end_input (teletext);
+  if (ret != GST_FLOW_OK)
+    return gst_teletextdec_input_error (teletext, ret);
+
+  return ret;
+}
+
+#define FNV_OFFSET_BASIS G_GUINT64_CONSTANT (0xcbf29ce484222325)
+#define FNV_PRIME G_GUINT64_CONSTANT (0x100000001b3)
+
+static guint64
+gst_teletextdec_hash_bytes (guint64 hash, gconstpointer data, gsize size)
+{
+  const guint8 *p = data;
+
+  while (size--) {
+    hash ^= *p++;
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+/* Hashes what @output would show of @page: the characters with their
+ * attributes and the colours */
+static guint64
+gst_teletextdec_page_hash (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page)
+{
+  guint64 hash = FNV_OFFSET_BASIS;
+  gint first_row = 0, n_rows = page->rows;
+
+  if (output->output_format == GST_TELETEXTDEC_OUTPUT_FORMAT_TEXT &&
+      teletext->subtitles_mode) {
+    /* only lines 2 to 23 make it into subtitles */
+    first_row = 1;
+    n_rows = MIN (page->rows, 23) - first_row;
+  }
+
+  hash = gst_teletextdec_hash_bytes (hash, &page->pgno, sizeof (page->pgno));
+  hash = gst_teletextdec_hash_bytes (hash, &page->subno, sizeof (page->subno));
+  hash = gst_teletextdec_hash_bytes (hash,
+      page->text + first_row * page->columns,
+      n_rows * page->columns * sizeof (vbi_char));
+  if (output->output_format != GST_TELETEXTDEC_OUTPUT_FORMAT_TEXT) {
+    hash = gst_teletextdec_hash_bytes (hash, &page->screen_color,
+        sizeof (page->screen_color));
+    hash = gst_teletextdec_hash_bytes (hash, page->color_map,
+        sizeof (page->color_map));
+  }
+
+  return hash;
+}
+
+/* Tells downstream that the stream advanced to @timestamp without a new
+ * buffer */
+static void
+gst_teletextdec_push_update (GstTeletextDec * teletext,
+    GstTeletextOutput * output, GstClockTime timestamp)
+{
+  GstSegment *segment = &teletext->segment;
+  gint64 start, position;
+
+  if (segment->format != GST_FORMAT_TIME ||
+      !GST_CLOCK_TIME_IS_VALID (timestamp))
+    return;
+
+  /* the held subtitle still has to be pushed before that position */
+  if (output->held != NULL)
+    return;
+
+  start = timestamp;
+  if (segment->stop != -1 && start > segment->stop)
+    return;
+  position = segment->time + (start - segment->start);
+
+  GST_LOG_OBJECT (teletext, "Page unchanged, updating segment on %s to %"
+      GST_TIME_FORMAT, GST_PAD_NAME (output->pad), GST_TIME_ARGS (start));
+
+  gst_pad_push_event (output->pad, gst_event_new_new_segment (TRUE,
+          segment->rate, segment->format, start, segment->stop, position));
+}
+
+/* Exports @page in the format of @output and returns in @export_time how
+ * long that took */
+static GstFlowReturn
+gst_teletextdec_export_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page, GstBuffer ** buf,
+    GstClockTime * export_time)
+{
+  GstFlowReturn ret;
+  GstClockTime start;
+
+  start = gst_util_get_timestamp ();
+  switch (output->output_format) {
+    case GST_TELETEXTDEC_OUTPUT_FORMAT_TEXT:
+      ret = gst_teletextdec_export_text_page (teletext, output, page, buf);
+      break;
+    case GST_TELETEXTDEC_OUTPUT_FORMAT_HTML:
+      ret = gst_teletextdec_export_html_page (teletext, output, page, buf);
+      break;
+    case GST_TELETEXTDEC_OUTPUT_FORMAT_RGBA:
+      ret = gst_teletextdec_export_rgba_page (teletext, output, page, buf);
+      break;
+    default:
+      g_assert_not_reached ();
+      ret = GST_FLOW_ERROR;
+      break;
+  }
+  *export_time = gst_util_get_timestamp () - start;
+
+  if (ret != GST_FLOW_OK)
+    GST_ERROR_OBJECT (teletext, "Error allocating output buffer, reason %s",
+        gst_flow_get_name (ret));
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_teletextdec_push_buffer (GstTeletextDec * teletext,
+    GstTeletextOutput * output, GstBuffer * buf, GstClockTime timestamp,
+    GstClockTime duration)
+{
+  GstFlowReturn ret;
+
+  GST_BUFFER_TIMESTAMP (buf) = timestamp;
+  GST_BUFFER_DURATION (buf) = duration;
+
+  GST_INFO_OBJECT (teletext, "Pushing buffer of size %d on %s",
+      GST_BUFFER_SIZE (buf), GST_PAD_NAME (output->pad));
+
+  ret = gst_pad_push (output->pad, buf);
+  if (ret != GST_FLOW_OK) {
+    GST_ERROR_OBJECT (teletext, "Pushing buffer failed, reason %s",
+        gst_flow_get_name (ret));
+    return ret;
+  }
+  g_mutex_lock (teletext->stats_lock);
+  teletext->published_stats.pages_pushed++;
+  g_mutex_unlock (teletext->stats_lock);
+
+  return GST_FLOW_OK;
+}
+
+/* Pushes the subtitle held on @output, lasting until @stop */
+static GstFlowReturn
+gst_teletextdec_push_held_output (GstTeletextDec * teletext,
+    GstTeletextOutput * output, GstClockTime stop)
+{
+  GstBuffer *buf = output->held;
+  GstClockTime timestamp, duration = GST_CLOCK_TIME_NONE;
+
+  if (buf == NULL)
+    return GST_FLOW_OK;
+  output->held = NULL;
+
+  timestamp = GST_BUFFER_TIMESTAMP (buf);
+  if (GST_CLOCK_TIME_IS_VALID (timestamp) && GST_CLOCK_TIME_IS_VALID (stop)
+      && stop > timestamp)
+    duration = stop - timestamp;
+
+  return gst_teletextdec_push_buffer (teletext, output, buf, timestamp,
+      duration);
+}
+
+/* Pushes the subtitles held on all pads, up to the end of their last
+ * repeat. Only called with no pages being exported. */
+static GstFlowReturn
+gst_teletextdec_push_held (GstTeletextDec * teletext)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GList *l;
+
+  for (l = teletext->outputs; l != NULL; l = l->next) {
+    GstTeletextOutput *output = (GstTeletextOutput *) l->data;
+    GstFlowReturn out_ret;
+
+    out_ret = gst_teletextdec_push_held_output (teletext, output,
+        output->held_stop);
+    if (out_ret != GST_FLOW_OK && ret == GST_FLOW_OK)
+      ret = out_ret;
+  }
+
+  return ret;
+}
+
+/* Pushes the subtitle in @buf only if its text differs from the one shown
+ * on @output. The shown subtitle is held back until then, to give it the
+ * duration up to the change; blank pages end it without being pushed. */
+static GstFlowReturn
+gst_teletextdec_push_subtitle_change (GstTeletextDec * teletext,
+    GstTeletextOutput * output, GstBuffer * buf, GstClockTime timestamp,
+    GstClockTime duration)
+{
+  GstBuffer *held = output->held;
+  GstFlowReturn ret;
+  gboolean blank;
+
+  blank = GST_BUFFER_SIZE (buf) <= 2 && GST_BUFFER_DATA (buf)[0] == '\n';
+
+  if (held != NULL && GST_BUFFER_SIZE (held) == GST_BUFFER_SIZE (buf) &&
+      !memcmp (GST_BUFFER_DATA (held), GST_BUFFER_DATA (buf),
+          GST_BUFFER_SIZE (buf))) {
+    /* repeat of the shown subtitle */
+    if (GST_CLOCK_TIME_IS_VALID (timestamp))
+      output->held_stop = GST_CLOCK_TIME_IS_VALID (duration) ?
+          timestamp + duration : timestamp;
+    gst_buffer_unref (buf);
+    return GST_FLOW_OK;
+  }
+
+  if (held == NULL && blank) {
+    /* nothing shown, the segment can advance */
+    gst_buffer_unref (buf);
+    gst_teletextdec_push_update (teletext, output, timestamp);
+    return GST_FLOW_OK;
+  }
+
+  ret = gst_teletextdec_push_held_output (teletext, output, timestamp);
+
+  if (blank) {
+    gst_buffer_unref (buf);
+  } else {
+    GST_BUFFER_TIMESTAMP (buf) = timestamp;
+    output->held = buf;
+    output->held_stop = GST_CLOCK_TIME_NONE;
+    if (GST_CLOCK_TIME_IS_VALID (timestamp) &&
+        GST_CLOCK_TIME_IS_VALID (duration))
+      output->held_stop = timestamp + duration;
+  }
+
+  return ret;
+}
+
+/* Pushes the page exported in @buf on @output */
+static GstFlowReturn
+gst_teletextdec_push_export (GstTeletextDec * teletext,
+    GstTeletextOutput * output, GstBuffer * buf, GstClockTime timestamp,
+    GstClockTime duration)
+{
+  if (teletext->subtitles_change_only && teletext->subtitles_mode &&
+      output->output_format == GST_TELETEXTDEC_OUTPUT_FORMAT_TEXT)
+    return gst_teletextdec_push_subtitle_change (teletext, output, buf,
+        timestamp, duration);
+
+  return gst_teletextdec_push_buffer (teletext, output, buf, timestamp,
+      duration);
+}
+
+static GstFlowReturn
+gst_teletextdec_push_output_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page)
+{
+  GstFlowReturn ret;
+  GstBuffer *buf;
+  GstClockTime export_time;
+  guint64 hash = 0;
+
+  if (teletext->deduplicate) {
+    hash = gst_teletextdec_page_hash (teletext, output, page);
+    if (output->has_hash && hash == output->last_hash) {
+      gst_teletextdec_push_update (teletext, output, teletext->in_timestamp);
+      return GST_FLOW_OK;
+    }
+  }
+
+  ret = gst_teletextdec_export_page (teletext, output, page, &buf,
+      &export_time);
+  if (ret != GST_FLOW_OK)
+    return ret;
+  gst_teletextdec_record_export (teletext, output->output_format, export_time);
+
+  ret = gst_teletextdec_push_export (teletext, output, buf,
+      teletext->in_timestamp, teletext->in_duration);
+  if (ret != GST_FLOW_OK)
+    return ret;
+
+  output->last_hash = hash;
+  output->has_hash = teletext->deduplicate;
+
+  return GST_FLOW_OK;
+}
+
+/* Whether @page shows DRCS characters */
+static gboolean
+gst_teletextdec_page_has_drcs (const vbi_page * page)
+{
+  gint i, n = page->rows * page->columns;
+
+  for (i = 0; i < n; i++) {
+    if (vbi_is_drcs (page->text[i].unicode))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Hands @page to the export pool. Returns the first error the pool ran
+ * into, as the pages are pushed from there. */
+static GstFlowReturn
+gst_teletextdec_queue_output_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page)
+{
+  GstFlowReturn ret;
+  export_job *job;
+
+  job = g_new0 (export_job, 1);
+  job->output = output;
+  job->timestamp = teletext->in_timestamp;
+  job->duration = teletext->in_duration;
+
+  /* deduplicate here, in the order the pages arrive */
+  if (teletext->deduplicate) {
+    guint64 hash = gst_teletextdec_page_hash (teletext, output, page);
+
+    if (!output->has_hash || hash != output->last_hash)
+      job->page = g_memdup (page, sizeof (vbi_page));
+    output->last_hash = hash;
+    output->has_hash = TRUE;
+  } else {
+    job->page = g_memdup (page, sizeof (vbi_page));
+  }
+
+  /* The copy still points to the DRCS patterns in the page cache, which
+   * changes while the stream is decoded. Draw such pages here, the job
+   * only pushes them in turn. */
+  if (job->page != NULL &&
+      output->output_format == GST_TELETEXTDEC_OUTPUT_FORMAT_RGBA &&
+      gst_teletextdec_page_has_drcs (page)) {
+    g_mutex_lock (output->lock);
+    job->ret = gst_teletextdec_export_page (teletext, output, page,
+        &job->buf, &job->export_time);
+    g_mutex_unlock (output->lock);
+    if (job->ret != GST_FLOW_OK)
+      job->buf = NULL;
+    g_free (job->page);
+    job->page = NULL;
+  }
+
+  g_mutex_lock (teletext->export_lock);
+  while (teletext->export_ret == GST_FLOW_OK &&
+      teletext->export_seqnum - teletext->export_push_seqnum >=
+      EXPORT_MAX_PENDING)
+    g_cond_wait (teletext->export_cond, teletext->export_lock);
+  ret = teletext->export_ret;
+  if (ret == GST_FLOW_OK)
+    job->seqnum = teletext->export_seqnum++;
+  g_mutex_unlock (teletext->export_lock);
+
+  if (ret != GST_FLOW_OK) {
+    if (job->buf != NULL)
+      gst_buffer_unref (job->buf);
+    g_free (job->page);
+    g_free (job);
+    return ret;
+  }
+
+  g_thread_pool_push (teletext->export_pool, job, NULL);
+
+  return GST_FLOW_OK;
+}
+
+/* Exports @page for @output, on the export pool if there is one */
+static GstFlowReturn
+gst_teletextdec_output_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page)
+{
+  if (teletext->export_pool != NULL)
+    return gst_teletextdec_queue_output_page (teletext, output, page);
+
+  return gst_teletextdec_push_output_page (teletext, output, page);
+}
+
+static gint
+gst_teletextdec_compare_jobs (gconstpointer a, gconstpointer b)
+{
+  const export_job *job_a = a, *job_b = b;
+
+  if (job_a->seqnum < job_b->seqnum)
+    return -1;
+  return job_a->seqnum > job_b->seqnum;
+}
+
+static GstFlowReturn
+gst_teletextdec_push_job (GstTeletextDec * teletext, export_job * job)
+{
+  GstFlowReturn ret = job->ret;
+
+  if (job->buf != NULL) {
+    gst_teletextdec_record_export (teletext, job->output->output_format,
+        job->export_time);
+    ret = gst_teletextdec_push_export (teletext, job->output, job->buf,
+        job->timestamp, job->duration);
+  } else if (ret == GST_FLOW_OK) {
+    gst_teletextdec_push_update (teletext, job->output, job->timestamp);
+  }
+  g_free (job);
+
+  return ret;
+}
+
+/* Runs on the export pool. The exports for a pad are serialized by its
+ * lock, and whichever worker finishes the next page in sequence pushes it
+ * along with the finished pages following it. */
+static void
+gst_teletextdec_export_func (gpointer data, gpointer user_data)
+{
+  GstTeletextDec *teletext = GST_TELETEXTDEC (user_data);
+  export_job *job = (export_job *) data;
+  GstFlowReturn ret;
+
+  if (job->page != NULL) {
+    g_mutex_lock (job->output->lock);
+    job->ret = gst_teletextdec_export_page (teletext, job->output, job->page,
+        &job->buf, &job->export_time);
+    g_mutex_unlock (job->output->lock);
+    g_free (job->page);
+    job->page = NULL;
+    if (job->ret != GST_FLOW_OK)
+      job->buf = NULL;
+  }
+
+  g_mutex_lock (teletext->export_lock);
+  teletext->export_done = g_list_insert_sorted (teletext->export_done, job,
+      gst_teletextdec_compare_jobs);
+  if (teletext->export_pushing)
+    goto done;
+
+  teletext->export_pushing = TRUE;
+  while (teletext->export_done != NULL) {
+    job = (export_job *) teletext->export_done->data;
+    if (job->seqnum != teletext->export_push_seqnum)
+      break;
+    teletext->export_done = g_list_delete_link (teletext->export_done,
+        teletext->export_done);
+    g_mutex_unlock (teletext->export_lock);
+
+    ret = gst_teletextdec_push_job (teletext, job);
+
+    g_mutex_lock (teletext->export_lock);
+    if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED &&
+        teletext->export_ret == GST_FLOW_OK)
+      teletext->export_ret = ret;
+    teletext->export_push_seqnum++;
+    g_cond_broadcast (teletext->export_cond);
+  }
+  teletext->export_pushing = FALSE;
+
+done:
+  g_mutex_unlock (teletext->export_lock);
+}
+
+/* Waits until all pages handed to the export pool have been pushed */
+static GstFlowReturn
+gst_teletextdec_drain_exports (GstTeletextDec * teletext)
+{
+  GstFlowReturn ret;
+
+  if (teletext->export_pool == NULL)
+    return GST_FLOW_OK;
+
+  g_mutex_lock (teletext->export_lock);
+  while (teletext->export_push_seqnum != teletext->export_seqnum)
+    g_cond_wait (teletext->export_cond, teletext->export_lock);
+  ret = teletext->export_ret;
+  g_mutex_unlock (teletext->export_lock);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_teletextdec_push_page (GstTeletextDec * teletext)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  vbi_page page;
+  GstTeletextPageInfo *pi;
+  guint head;
+  vbi_pgno pgno;
+  vbi_subno subno;
+  gboolean success;
+  GList *l;
+
+  /* copy the entry out and free the slot before exporting, so that the
+   * producer is never held up by the downstream push */
+  head = teletext->queue_head;
+  pi = &teletext->queue[head & (PAGE_QUEUE_SIZE - 1)];
+  pgno = pi->pgno;
+  subno = pi->subno;
+  /* the page is pushed with the timestamp of the buffer it came in */
+  teletext->in_timestamp = pi->timestamp;
+  teletext->in_duration = pi->duration;
+  g_atomic_int_set (&teletext->queue_head, head + 1);
+
+  GST_INFO_OBJECT (teletext, "Fetching teletext page %03d.%02d",
+      (gint) vbi_bcd2dec (pgno), (gint) vbi_bcd2dec (subno));
+
+  success = vbi_fetch_vt_page (teletext->decoder, &page, pgno, subno,
+      VBI_WST_LEVEL_3p5, 25, FALSE);
+  if (G_UNLIKELY (!success))
+    goto fetch_page_failed;
+
+  /* the page is fetched once and exported for every pad showing it; an
+   * unlinked pad is skipped, see gst_teletextdec_end_input(). The zvbi
+   * cache is not thread safe, so pages are fetched here even when the
+   * export pool renders them. */
+  for (l = teletext->outputs; l != NULL; l = l->next) {
+    GstTeletextOutput *output = (GstTeletextOutput *) l->data;
+    GstFlowReturn out_ret;
+
+    if (!gst_teletextdec_output_wants_page (teletext, output, pgno, subno))
+      continue;
+
+    out_ret = gst_teletextdec_output_page (teletext, output, &page);
+    if (out_ret != GST_FLOW_OK && out_ret != GST_FLOW_NOT_LINKED) {
+      ret = out_ret;
+      break;
+    }
+  }
+  vbi_unref_page (&page);
+
+  return ret;
+
+fetch_page_failed:
+  {
+    GST_ELEMENT_ERROR (teletext, RESOURCE, READ, (NULL), (NULL));
+    return GST_FLOW_ERROR;
+  }
+}
+
+/* Returns page @pgno of the @n_pages @pages sorted by page number, or
+ * NULL */
+static const vbi_page *
+gst_teletextdec_find_page (const vbi_page * pages, guint n_pages,
+    vbi_pgno pgno)
+{
+  guint lo = 0, hi = n_pages;
+
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+
+    if (pages[mid].pgno < pgno)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo < n_pages && pages[lo].pgno == pgno)
+    return &pages[lo];
+  return NULL;
+}
+
+/* Returns page @pgno of the page cache, or NULL */
+static const vbi_page *
+gst_teletextdec_snapshot_page (GstTeletextDec * teletext, vbi_pgno pgno)
+{
+  if (teletext->snapshot == NULL)
+    return NULL;
+
+  return gst_teletextdec_find_page ((const vbi_page *)
+      (g_mapped_file_get_contents (teletext->snapshot) +
+          sizeof (cache_header)), teletext->n_snapshot_pages, pgno);
+}
+
+/* Pushes the cached pages the pads show */
+static GstFlowReturn
+gst_teletextdec_serve_snapshot (GstTeletextDec * teletext)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GList *l;
+
+  teletext->snapshot_served = TRUE;
+
+  for (l = teletext->outputs; l != NULL; l = l->next) {
+    GstTeletextOutput *output = (GstTeletextOutput *) l->data;
+    const vbi_page *cached;
+    vbi_page page;
+
+    cached = gst_teletextdec_snapshot_page (teletext,
+        output->pad == teletext->srcpad ? teletext->pageno : output->pageno);
+    if (cached == NULL || !gst_teletextdec_output_wants_page (teletext, output,
+            cached->pgno, cached->subno))
+      continue;
+
+    GST_INFO_OBJECT (teletext, "Showing page %03x.%02x from the page cache",
+        cached->pgno, cached->subno);
+
+    memcpy (&page, cached, sizeof (vbi_page));
+    ret = gst_teletextdec_output_page (teletext, output, &page);
+    if (ret == GST_FLOW_NOT_LINKED)
+      ret = GST_FLOW_OK;
+    else if (ret != GST_FLOW_OK)
+      break;
+  }
+
+  return ret;
+}
+
+/* Returns the position in the input segment the pipeline is playing now:
+ * the running time of the element clock mapped back through the segment.
+ * Returns GST_CLOCK_TIME_NONE when not playing or not in a time segment. */
+static GstClockTime
+gst_teletextdec_current_position (GstTeletextDec * teletext)
+{
+  GstSegment *segment = &teletext->segment;
+  GstClock *clock;
+  GstClockTime base_time, now;
+  guint64 running_time;
+
+  if (segment->format != GST_FORMAT_TIME)
+    return GST_CLOCK_TIME_NONE;
+
+  GST_OBJECT_LOCK (teletext);
+  clock = GST_ELEMENT_CLOCK (teletext);
+  if (clock == NULL || GST_STATE (teletext) != GST_STATE_PLAYING) {
+    GST_OBJECT_UNLOCK (teletext);
+    return GST_CLOCK_TIME_NONE;
+  }
+  gst_object_ref (clock);
+  base_time = GST_ELEMENT_CAST (teletext)->base_time;
+  GST_OBJECT_UNLOCK (teletext);
+
+  now = gst_clock_get_time (clock);
+  gst_object_unref (clock);
+
+  /* the inverse of gst_segment_to_running_time() */
+  if (now < base_time || now - base_time < segment->accum)
+    return GST_CLOCK_TIME_NONE;
+  running_time = now - base_time - segment->accum;
+  if (segment->abs_rate != 1.0)
+    running_time = running_time * segment->abs_rate;
+
+  if (segment->rate > 0.0) {
+    if (segment->stop != -1 && segment->start + running_time > segment->stop)
+      return GST_CLOCK_TIME_NONE;
+    return segment->start + running_time;
+  }
+
+  if (segment->stop == -1 || segment->stop - segment->start < running_time)
+    return GST_CLOCK_TIME_NONE;
+  return segment->stop - running_time;
+}
+
+/* Pushes the page the page and subpage properties were changed to, if the
+ * decoder or the page cache has it, instead of waiting for it to be
+ * transmitted again */
+static GstFlowReturn
+gst_teletextdec_show_new_page (GstTeletextDec * teletext)
+{
+  GstTeletextOutput *output;
+  GstFlowReturn ret;
+  const vbi_page *cached;
+  vbi_page page;
+  vbi_pgno pgno;
+  vbi_subno subno;
+  GstClockTime timestamp, position;
+
+  GST_OBJECT_LOCK (teletext);
+  pgno = teletext->pageno;
+  subno = teletext->subno;
+  teletext->page_changed = FALSE;
+  GST_OBJECT_UNLOCK (teletext);
+
+  output = (GstTeletextOutput *)
+      gst_pad_get_element_private (teletext->srcpad);
+
+  /* the page is shown now, which can be long after the last input on a
+   * sparse stream, but never before pages already pushed */
+  timestamp = teletext->in_timestamp;
+  position = gst_teletextdec_current_position (teletext);
+  if (GST_CLOCK_TIME_IS_VALID (position) &&
+      (!GST_CLOCK_TIME_IS_VALID (timestamp) || position > timestamp))
+    teletext->in_timestamp = position;
+
+  if (vbi_fetch_vt_page (teletext->decoder, &page, pgno,
+          subno == -1 ? VBI_ANY_SUBNO : subno, VBI_WST_LEVEL_3p5, 25,
+          FALSE)) {
+    GST_INFO_OBJECT (teletext, "Showing page %03x.%02x from the decoder",
+        page.pgno, page.subno);
+    ret = gst_teletextdec_output_page (teletext, output, &page);
+    vbi_unref_page (&page);
+  } else if ((cached = gst_teletextdec_snapshot_page (teletext, pgno)) != NULL
+      && (subno == -1 || cached->subno == subno)) {
+    GST_INFO_OBJECT (teletext, "Showing page %03x.%02x from the page cache",
+        cached->pgno, cached->subno);
+    memcpy (&page, cached, sizeof (vbi_page));
+    ret = gst_teletextdec_output_page (teletext, output, &page);
+  } else {
+    GST_DEBUG_OBJECT (teletext, "Page %03x not received yet", pgno);
+    ret = GST_FLOW_OK;
+  }
+  teletext->in_timestamp = timestamp;
+
+  /* nobody watching the page is no reason to stop */
+  if (ret == GST_FLOW_NOT_LINKED)
+    ret = GST_FLOW_OK;
+
+  return ret;
+}
+
+/* Whether the @n_pages pages of a page cache file can be served: each fits
+ * in a vbi_page, has a page number and no pointers, and they are sorted by
+ * page number for gst_teletextdec_snapshot_page() */
+static gboolean
+gst_teletextdec_cache_pages_valid (const vbi_page * pages, guint n_pages)
+{
+  guint i, j;
+
+  for (i = 0; i < n_pages; i++) {
+    const vbi_page *page = &pages[i];
+
+    if (page->rows < 1 || page->rows > 25 ||
+        page->columns < 1 || page->columns > 41 ||
+        page->rows * page->columns > G_N_ELEMENTS (page->text))
+      return FALSE;
+    if (page->pgno < 0x100 || page->pgno > 0x8FF ||
+        (i > 0 && page->pgno <= pages[i - 1].pgno))
+      return FALSE;
+
+    if (page->vbi != NULL || page->drcs_clut != NULL)
+      return FALSE;
+    for (j = 0; j < G_N_ELEMENTS (page->drcs); j++) {
+      if (page->drcs[j] != NULL)
+        return FALSE;
+    }
+    for (j = 0; j < G_N_ELEMENTS (page->font); j++) {
+      if (page->font[j] != NULL)
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Returns the version of the zvbi library in use as 0xMMmmuu */
+static guint32
+gst_teletextdec_zvbi_version (void)
+{
+  unsigned int major, minor, micro;
+
+  vbi_version (&major, &minor, &micro);
+
+  return (major & 0xFF) << 16 | (minor & 0xFF) << 8 | (micro & 0xFF);
+}
+
+static void
+gst_teletextdec_load_cache (GstTeletextDec * teletext)
+{
+  const cache_header *header;
+  GMappedFile *file;
+  GError *error = NULL;
+  gsize length;
+
+  if (teletext->cache_file == NULL)
+    return;
+
+  file = g_mapped_file_new (teletext->cache_file, FALSE, &error);
+  if (file == NULL) {
+    GST_DEBUG_OBJECT (teletext, "No page cache loaded: %s", error->message);
+    g_error_free (error);
+    return;
+  }
+
+  length = g_mapped_file_get_length (file);
+  header = (const cache_header *) g_mapped_file_get_contents (file);
+  if (length < sizeof (cache_header) ||
+      memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != CACHE_VERSION ||
+      header->byte_order != CACHE_BYTE_ORDER ||
+      header->zvbi_version != gst_teletextdec_zvbi_version () ||
+      header->page_size != sizeof (vbi_page) ||
+      header->n_pages > 0x800 ||
+      length != sizeof (cache_header) + header->n_pages * sizeof (vbi_page))
+    goto invalid_cache;
+
+  /* a single bad entry may mean anything, so the whole file is dropped */
+  if (!gst_teletextdec_cache_pages_valid ((const vbi_page *) (header + 1),
+          header->n_pages))
+    goto invalid_cache;
+
+  teletext->snapshot = file;
+  teletext->n_snapshot_pages = header->n_pages;
+  teletext->snapshot_cni = header->cni;
+  teletext->snapshot_served = FALSE;
+
+  GST_INFO_OBJECT (teletext, "Loaded %u pages of network %04x from %s",
+      header->n_pages, header->cni, teletext->cache_file);
+  return;
+
+invalid_cache:
+  {
+    GST_WARNING_OBJECT (teletext, "Ignoring invalid page cache %s",
+        teletext->cache_file);
+    g_mapped_file_free (file);
+  }
+}
+
+static void
+gst_teletextdec_drop_snapshot (GstTeletextDec * teletext)
+{
+  if (teletext->snapshot != NULL) {
+    g_mapped_file_free (teletext->snapshot);
+    teletext->snapshot = NULL;
+  }
+  teletext->n_snapshot_pages = 0;
+}
+
+/* Waits until the cache thread wrote the last save */
+static void
+gst_teletextdec_join_cache_thread (GstTeletextDec * teletext)
+{
+  if (teletext->cache_thread == NULL)
+    return;
+
+  g_thread_join (teletext->cache_thread);
+  teletext->cache_thread = NULL;
+  g_free (teletext->cache_image_file);
+  teletext->cache_image_file = NULL;
+}
+
+/* Runs on the cache thread, writing the image of the last save */
+static gpointer
+gst_teletextdec_write_cache_func (gpointer data)
+{
+  GstTeletextDec *teletext = GST_TELETEXTDEC (data);
+  const cache_header *header = (const cache_header *) teletext->cache_image;
+  gsize size = sizeof (cache_header) + header->n_pages * sizeof (vbi_page);
+  GError *error = NULL;
+
+  if (!g_file_set_contents (teletext->cache_image_file,
+          (const gchar *) header, size, &error)) {
+    GST_WARNING_OBJECT (teletext, "Could not save the page cache: %s",
+        error->message);
+    g_error_free (error);
+  } else {
+    GST_DEBUG_OBJECT (teletext, "Saved %u pages to %s", header->n_pages,
+        teletext->cache_image_file);
+  }
+
+  g_atomic_int_set (&teletext->cache_writing, FALSE);
+  return NULL;
+}
+
+/* Saves the last subpage of every page received, and the pages of the last
+ * save and of the page cache that weren't received again. Only the pages
+ * received since the last save are fetched from the decoder, the file is
+ * written on the cache thread. With @wait the file is written on return.
+ * Without, nothing is saved while the last save is still being written. */
+static void
+gst_teletextdec_save_cache (GstTeletextDec * teletext, gboolean wait)
+{
+  const cache_header *saved;
+  const vbi_page *saved_pages = NULL;
+  cache_header *header;
+  vbi_page *pages;
+  guint i, cni, n_saved = 0, n_pages = 0;
+  GError *error = NULL;
+
+  if (teletext->cache_file == NULL || teletext->decoder == NULL)
+    return;
+
+  if (teletext->cache_thread != NULL) {
+    if (!wait && g_atomic_int_get (&teletext->cache_writing)) {
+      GST_DEBUG_OBJECT (teletext, "Still writing the last page cache");
+      return;
+    }
+    gst_teletextdec_join_cache_thread (teletext);
+  }
+
+  cni = teletext->network_cni != 0 ? teletext->network_cni :
+      teletext->snapshot_cni;
+  /* the pages of the last save may belong to another network */
+  saved = (const cache_header *) teletext->cache_image;
+  if (saved != NULL && (saved->cni == 0 || cni == 0 || saved->cni == cni)) {
+    saved_pages = (const vbi_page *) (saved + 1);
+    n_saved = saved->n_pages;
+  }
+
+  for (i = 0; i < 0x800; i++) {
+    if ((teletext->pages_dirty[i / 8] & (1 << (i % 8))) ||
+        gst_teletextdec_find_page (saved_pages, n_saved, 0x100 + i) != NULL ||
+        gst_teletextdec_snapshot_page (teletext, 0x100 + i) != NULL)
+      n_pages++;
+  }
+  if (n_pages == 0)
+    return;
+
+  header = g_malloc (sizeof (cache_header) + n_pages * sizeof (vbi_page));
+  pages = (vbi_page *) (header + 1);
+
+  n_pages = 0;
+  for (i = 0; i < 0x800; i++) {
+    vbi_pgno pgno = 0x100 + i;
+    const vbi_page *cached;
+    vbi_page *page = &pages[n_pages];
+
+    if ((teletext->pages_dirty[i / 8] & (1 << (i % 8))) &&
+        vbi_fetch_vt_page (teletext->decoder, page, pgno, VBI_ANY_SUBNO,
+            VBI_WST_LEVEL_3p5, 25, FALSE)) {
+      vbi_unref_page (page);
+      /* the pointers only make sense to the decoder that filled the page */
+      page->vbi = NULL;
+      page->drcs_clut = NULL;
+      memset (page->drcs, 0, sizeof (page->drcs));
+      memset (page->font, 0, sizeof (page->font));
+    } else if ((cached = gst_teletextdec_find_page (saved_pages, n_saved,
+                pgno)) != NULL
+        || (cached = gst_teletextdec_snapshot_page (teletext, pgno)) != NULL) {
+      memcpy (page, cached, sizeof (vbi_page));
+    } else {
+      continue;
+    }
+    n_pages++;
+  }
+  memset (teletext->pages_dirty, 0, sizeof (teletext->pages_dirty));
+
+  memcpy (header->magic, CACHE_MAGIC, sizeof (header->magic));
+  header->version = CACHE_VERSION;
+  header->byte_order = CACHE_BYTE_ORDER;
+  header->zvbi_version = gst_teletextdec_zvbi_version ();
+  header->page_size = sizeof (vbi_page);
+  header->cni = cni;
+  header->n_pages = n_pages;
+
+  /* nothing reads the last image any more */
+  g_free (teletext->cache_image);
+  teletext->cache_image = header;
+  teletext->cache_image_file = g_strdup (teletext->cache_file);
+
+  g_atomic_int_set (&teletext->cache_writing, TRUE);
+  teletext->cache_thread = g_thread_create (gst_teletextdec_write_cache_func,
+      teletext, TRUE, &error);
+  if (teletext->cache_thread == NULL) {
+    GST_WARNING_OBJECT (teletext, "Could not save the page cache: %s",
+        error->message);
+    g_error_free (error);
+    g_atomic_int_set (&teletext->cache_writing, FALSE);
+    g_free (teletext->cache_image_file);
+    teletext->cache_image_file = NULL;
+    return;
+  }
+
+  if (wait)
+    gst_teletextdec_join_cache_thread (teletext);
+}
+
+/* UTF-8 encodings of the code points below 0x800, the first byte holds the
+ * length. That covers all characters of the teletext character sets but
+ * the mosaics, which zvbi maps to the private use area. */
+static guint8 utf8_table[0x800][3];
+
+static void
+gst_teletextdec_init_utf8_table (void)
+{
+  guint c;
+
+  for (c = 0; c < 0x80; c++) {
+    utf8_table[c][0] = 1;
+    utf8_table[c][1] = c;
+  }
+  for (c = 0x80; c < 0x800; c++) {
+    utf8_table[c][0] = 2;
+    utf8_table[c][1] = 0xC0 | (c >> 6);
+    utf8_table[c][2] = 0x80 | (c & 0x3F);
+  }
+}
+
+/* Parses @set, page numbers and ranges of them separated by commas, into
+ * the cache_pages bitmap */
+static void
+gst_teletextdec_set_cache_page_set (GstTeletextDec * teletext,
+    const gchar * set)
+{
+  gchar **items;
+  guint i;
+
+  g_free (teletext->cache_page_set);
+  teletext->cache_page_set = g_strdup (set);
+  memset (teletext->cache_pages, 0, sizeof (teletext->cache_pages));
+  if (set == NULL)
+    return;
+
+  items = g_strsplit (set, ",", -1);
+  for (i = 0; items[i] != NULL; i++) {
+    gint first, last, page;
+
+    switch (sscanf (items[i], "%d-%d", &first, &last)) {
+      case 1:
+        last = first;
+        break;
+      case 2:
+        break;
+      default:
+        GST_WARNING_OBJECT (teletext, "Ignoring page set item '%s'",
+            items[i]);
+        continue;
+    }
+    if (first < 100 || last > 899 || first > last) {
+      GST_WARNING_OBJECT (teletext, "Ignoring page range %d-%d", first,
+          last);
+      continue;
+    }
+
+    for (page = first; page <= last; page++) {
+      gint pgno = vbi_bin2bcd (page) - 0x100;
+
+      teletext->cache_pages[pgno / 8] |= 1 << (pgno % 8);
+    }
+  }
+  g_strfreev (items);
+}
+
+/* Splits @template around its first %s, so that each line only needs two
+ * copies; %% stands for %, like in printf */
+static void
+gst_teletextdec_set_subtitles_template (GstTeletextDec * teletext,
+    const gchar * template)
+{
+  GString *parts[2];
+  gint part = 0;
+  const gchar *p;
+
+  if (template == NULL)
+    template = "%s\n";
+
+  parts[0] = g_string_new ("");
+  parts[1] = g_string_new ("");
+  for (p = template; *p != '\0'; p++) {
+    if (p[0] == '%' && p[1] == '%') {
+      g_string_append_c (parts[part], '%');
+      p++;
+    } else if (p[0] == '%' && p[1] == 's' && part == 0) {
+      part = 1;
+      p++;
+    } else {
+      g_string_append_c (parts[part], *p);
+    }
+  }
+
+  g_free (teletext->subtitles_template);
+  g_free (teletext->subtitles_prefix);
+  g_free (teletext->subtitles_suffix);
+  teletext->subtitles_template = g_strdup (template);
+  teletext->subtitles_prefix = g_string_free (parts[0], FALSE);
+  teletext->subtitles_suffix = g_string_free (parts[1], FALSE);
+}
+
+/* Returns the character shown in @ac as it goes into subtitles, or 0 if
+ * the cell is covered by a double width or height character */
+static inline guint
+gst_teletextdec_subtitles_char (const vbi_char * ac)
+{
+  if (ac->size > VBI_DOUBLE_SIZE)
+    return 0;
+  /* control codes, mosaics and DRCS */
+  if (ac->unicode < 0x20 || (ac->unicode >= 0xE000 && ac->unicode <= 0xF8FF))
+    return 0x20;
+  return ac->unicode;
+}
+
+/* Appends the text of a row with the template around it, unless the row is
+ * blank. Leading and trailing blanks are stripped. */
+static void
+gst_teletextdec_append_subtitles_row (GstTeletextDec * teletext,
+    GString * subs, const vbi_char * row, gint columns)
+{
+  gint first, last, i;
+  gsize len;
+  guint8 *out;
+
+  for (first = 0; first < columns; first++) {
+    if (gst_teletextdec_subtitles_char (&row[first]) > 0x20)
+      break;
+  }
+  if (first == columns)
+    return;
+  for (last = columns - 1; last > first; last--) {
+    if (gst_teletextdec_subtitles_char (&row[last]) > 0x20)
+      break;
+  }
 
-/* ERRORS */
-error:
-  {
-    if (GST_FLOW_IS_FATAL (ret)) {
-      GST_ELEMENT_ERROR (teletext, STREAM, FAILED,
-          ("Internal data stream error."),
-          ("stream stopped, reason %s", gst_flow_get_name (ret)));
-      gst_pad_push_event (teletext->srcpad, gst_event_new_eos ());
+  g_string_append (subs, teletext->subtitles_prefix);
+
+  /* reserve the longest encoding and trim afterwards */
+  len = subs->len;
+  g_string_set_size (subs, len + (last - first + 1) * 4);
+  out = (guint8 *) subs->str + len;
+  for (i = first; i <= last; i++) {
+    guint c = gst_teletextdec_subtitles_char (&row[i]);
+
+    if (G_LIKELY (c != 0 && c < 0x800)) {
+      out[0] = utf8_table[c][1];
+      out[1] = utf8_table[c][2];
+      out += utf8_table[c][0];
+    } else if (c != 0) {
+      out += g_unichar_to_utf8 (c, (gchar *) out);
     }
-    return ret;
   }
+  g_string_truncate (subs, out - (guint8 *) subs->str);
+
+  g_string_append (subs, teletext->subtitles_suffix);
+}
+
+/* Puts the text of rows 2 to 23 of @page into the reusable string of
+ * @output */
+static GString *
+gst_teletextdec_parse_subtitles_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page)
+{
+  GString *subs;
+  gint i;
+
+  if (output->text == NULL)
+    output->text = g_string_sized_new (256);
+  subs = output->text;
+  g_string_truncate (subs, 0);
+
+  for (i = 1; i < 23 && i < page->rows; i++)
+    gst_teletextdec_append_subtitles_row (teletext, subs,
+        page->text + i * page->columns, page->columns);
+
+  if (subs->len == 0)
+    g_string_append_c (subs, '\n');
+
+  return subs;
+}
+
+/* Gives the buffers of @output the caps @mimetype until downstream picks
+ * caps for the pad */
+static void
+gst_teletextdec_output_set_caps (GstTeletextOutput * output,
+    const gchar * mimetype)
+{
+  GstCaps *caps;
+
+  if (G_LIKELY (output->pool->caps != NULL))
+    return;
+
+  caps = gst_caps_new_simple (mimetype, NULL);
+  gst_teletextdec_pool_set_caps (output->pool, caps);
+  gst_caps_unref (caps);
 }
 
 static GstFlowReturn
-gst_teletextdec_push_page (GstTeletextDec * teletext)
+gst_teletextdec_export_text_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page, GstBuffer ** buf)
+{
+  guint size;
+
+  gst_teletextdec_output_set_caps (output, "text/plain");
+
+  if (teletext->subtitles_mode) {
+    GString *subs = gst_teletextdec_parse_subtitles_page (teletext, output,
+        page);
+
+    *buf = gst_teletextdec_pool_acquire (output->pool, subs->len + 1);
+    memcpy (GST_BUFFER_DATA (*buf), subs->str, subs->len + 1);
+  } else {
+    size = page->columns * page->rows;
+    *buf = gst_teletextdec_pool_acquire (output->pool, size);
+    vbi_print_page (page, (gchar *) GST_BUFFER_DATA (*buf), size, "UTF-8",
+        FALSE, TRUE);
+  }
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_teletextdec_export_html_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page, GstBuffer ** buf)
 {
   GstFlowReturn ret = GST_FLOW_OK;
-  GstBuffer *buf;
-  vbi_page page;
-  page_info *pi;
-  gint pgno, subno;
-  gboolean success;
+  gssize size;
+  gchar *err;
 
-  pi = (page_info *) g_queue_pop_head (teletext->queue);
+  gst_teletextdec_output_set_caps (output, "text/html");
+  *buf = gst_teletextdec_pool_acquire (output->pool, HTML_BUFFER_SIZE);
+
+  /* the exporter is shared by all pads */
+  g_mutex_lock (teletext->exporter_lock);
+
+  /* the exporter lives as long as the decoder */
+  if (teletext->exporter == NULL) {
+    teletext->exporter = vbi_export_new ("html", &err);
+    if (teletext->exporter == NULL) {
+      GST_ELEMENT_ERROR (teletext, LIBRARY, SETTINGS,
+          ("Can't open the HTML export module: %s", err), (NULL));
+      g_free (err);
+      ret = GST_FLOW_ERROR;
+      goto done;
+    }
+  }
 
-  pgno = vbi_bcd2dec (pi->pgno);
-  subno = vbi_bcd2dec (pi->subno);
+  /* export straight into the buffer. Pages of a stream export to about the
+   * same size, so a single pass is enough once the buffers of the pool have
+   * grown to fit them; the exporter returns the size it needs when it
+   * doesn't. */
+  size = vbi_export_mem (teletext->exporter, GST_BUFFER_DATA (*buf),
+      GST_TELETEXT_BUFFER_CAPACITY (*buf), page);
+  if (G_UNLIKELY (size > (gssize) GST_TELETEXT_BUFFER_CAPACITY (*buf))) {
+    GST_DEBUG_OBJECT (teletext, "Growing HTML buffer to %" G_GSSIZE_FORMAT
+        " bytes", size);
+    gst_teletextdec_buffer_reserve (*buf, size);
+    size = vbi_export_mem (teletext->exporter, GST_BUFFER_DATA (*buf),
+        GST_TELETEXT_BUFFER_CAPACITY (*buf), page);
+  }
+  if (G_UNLIKELY (size < 0 ||
+          size > (gssize) GST_TELETEXT_BUFFER_CAPACITY (*buf))) {
+    GST_ELEMENT_ERROR (teletext, LIBRARY, FAILED,
+        ("Can't export page as HTML: %s",
+            vbi_export_errstr (teletext->exporter)), (NULL));
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+  GST_BUFFER_SIZE (*buf) = size;
 
-  GST_INFO_OBJECT (teletext, "Fetching teletext page %03d.%02d", pgno, subno);
+done:
+  g_mutex_unlock (teletext->exporter_lock);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (*buf);
+    *buf = NULL;
+  }
+  return ret;
+}
 
-  success = vbi_fetch_vt_page (teletext->decoder, &page, pi->pgno, pi->subno,
-      VBI_WST_LEVEL_3p5, 25, FALSE);
-  if (G_UNLIKELY (!success))
-    goto fetch_page_failed;
+/* Whether everything but the characters of two pages is drawn the same */
+static gboolean
+gst_teletextdec_page_layout_equal (const vbi_page * a, const vbi_page * b)
+{
+  gint i;
 
-  switch (teletext->output_format) {
-    case GST_TELETEXTDEC_OUTPUT_FORMAT_TEXT:
-      ret = gst_teletextdec_export_text_page (teletext, &page, &buf);
-      break;
-    case GST_TELETEXTDEC_OUTPUT_FORMAT_HTML:
-      ret = gst_teletextdec_export_html_page (teletext, &page, &buf);
-      break;
-    case GST_TELETEXTDEC_OUTPUT_FORMAT_RGBA:
-      ret = gst_teletextdec_export_rgba_page (teletext, &page, &buf);
-      break;
-    default:
-      g_assert_not_reached ();
-      break;
+  if (a->rows != b->rows || a->columns != b->columns ||
+      a->screen_color != b->screen_color ||
+      a->screen_opacity != b->screen_opacity || a->drcs_clut != b->drcs_clut)
+    return FALSE;
+
+  for (i = 0; i < G_N_ELEMENTS (a->drcs); i++) {
+    if (a->drcs[i] != b->drcs[i])
+      return FALSE;
   }
-  vbi_unref_page (&page);
-  g_free (pi);
 
-  if (ret != GST_FLOW_OK)
-    goto alloc_failed;
+  return memcmp (a->color_map, b->color_map, sizeof (a->color_map)) == 0;
+}
 
-  GST_BUFFER_TIMESTAMP (buf) = teletext->in_timestamp;
-  GST_BUFFER_DURATION (buf) = teletext->in_duration;
+/* Whether row @row has to be redrawn to turn @old into @page */
+static gboolean
+gst_teletextdec_row_changed (const vbi_page * page, const vbi_page * old,
+    gint row)
+{
+  const vbi_char *ac = page->text + row * page->columns;
+  gint i;
 
-  GST_INFO_OBJECT (teletext, "Pushing buffer of size %d",
-      GST_BUFFER_SIZE (buf));
+  if (memcmp (ac, old->text + row * page->columns,
+          page->columns * sizeof (vbi_char)) != 0)
+    return TRUE;
 
-  ret = gst_pad_push (teletext->srcpad, buf);
-  if (ret != GST_FLOW_OK)
-    goto push_failed;
+  /* the DRCS patterns may change behind unchanged characters */
+  for (i = 0; i < page->columns; i++) {
+    if (vbi_is_drcs (ac[i].unicode))
+      return TRUE;
+  }
 
-  return GST_FLOW_OK;
+  return FALSE;
+}
 
-fetch_page_failed:
-  {
-    GST_ELEMENT_ERROR (teletext, RESOURCE, READ, (NULL), (NULL));
-    return GST_FLOW_ERROR;
+static guint
+gst_teletextdec_glyph_hash (gconstpointer key)
+{
+  return (guint) gst_teletextdec_hash_bytes (FNV_OFFSET_BASIS, key,
+      sizeof (glyph_key));
+}
+
+static gboolean
+gst_teletextdec_glyph_equal (gconstpointer a, gconstpointer b)
+{
+  return memcmp (a, b, sizeof (glyph_key)) == 0;
+}
+
+/* Returns the pixels of the character cell @ac of @page, drawn by zvbi on
+ * a page of its own the first time it is seen */
+static const vbi_rgba *
+gst_teletextdec_lookup_glyph (GstTeletextOutput * output,
+    const vbi_page * page, const vbi_char * ac)
+{
+  glyph_key key;
+  glyph_tile *tile;
+  vbi_page *pg;
+
+  key.foreground = page->color_map[ac->foreground];
+  key.background = page->color_map[ac->background];
+  key.unicode = ac->unicode;
+  key.attributes = ac->underline | ac->bold << 1 | ac->italic << 2 |
+      ac->flash << 3 | ac->conceal << 4 | ac->proportional << 5 |
+      ac->link << 6 | ac->opacity << 8;
+
+  if (G_UNLIKELY (output->glyphs == NULL)) {
+    output->glyphs = g_hash_table_new_full (gst_teletextdec_glyph_hash,
+        gst_teletextdec_glyph_equal, g_free, NULL);
+    output->glyph_page = g_new0 (vbi_page, 1);
   }
 
-alloc_failed:
-  {
-    GST_ERROR_OBJECT (teletext, "Error allocating output buffer, reason %s",
-        gst_flow_get_name (ret));
-    return ret;
+  tile = g_hash_table_lookup (output->glyphs, &key);
+  if (G_LIKELY (tile != NULL))
+    return tile->pixels;
+
+  if (g_hash_table_size (output->glyphs) >= MAX_GLYPH_TILES)
+    g_hash_table_remove_all (output->glyphs);
+
+  pg = output->glyph_page;
+  pg->rows = 1;
+  pg->columns = 1;
+  pg->text[0] = *ac;
+  pg->text[0].foreground = 0;
+  pg->text[0].background = 1;
+  pg->color_map[0] = key.foreground;
+  pg->color_map[1] = key.background;
+
+  tile = g_new (glyph_tile, 1);
+  tile->key = key;
+  vbi_draw_vt_page_region (pg, VBI_PIXFMT_RGBA32_LE, tile->pixels,
+      GLYPH_WIDTH * sizeof (vbi_rgba), 0, 0, 1, 1, FALSE, TRUE);
+  g_hash_table_insert (output->glyphs, tile, tile);
+
+  return tile->pixels;
+}
+
+/* Draws row @row of @page from the glyph cache of @output, one pixel line
+ * of all its cells at a time. Returns FALSE without drawing if the row has
+ * DRCS or cells that are not of normal size, which are left to zvbi. */
+static gboolean
+gst_teletextdec_draw_glyph_row (GstTeletextOutput * output, vbi_page * page,
+    gint row, guint8 * dest, gint rowstride)
+{
+  const vbi_char *ac = page->text + row * page->columns;
+  const vbi_rgba *tiles[64];
+  gint i, y;
+
+  if (G_UNLIKELY (page->columns > G_N_ELEMENTS (tiles)))
+    return FALSE;
+
+  for (i = 0; i < page->columns; i++) {
+    if (ac[i].size != VBI_NORMAL_SIZE || vbi_is_drcs (ac[i].unicode))
+      return FALSE;
   }
+  for (i = 0; i < page->columns; i++)
+    tiles[i] = gst_teletextdec_lookup_glyph (output, page, &ac[i]);
 
-push_failed:
-  {
-    GST_ERROR_OBJECT (teletext, "Pushing buffer failed, reason %s",
-        gst_flow_get_name (ret));
-    return ret;
+  for (y = 0; y < GLYPH_HEIGHT; y++) {
+    guint8 *d = dest + y * rowstride;
+
+    for (i = 0; i < page->columns; i++) {
+      memcpy (d, tiles[i] + y * GLYPH_WIDTH, GLYPH_WIDTH * sizeof (vbi_rgba));
+      d += GLYPH_WIDTH * sizeof (vbi_rgba);
+    }
   }
+
+  return TRUE;
 }
 
-static gint
-gst_teletextdec_parse_subtitles_page (GstTeletextDec * teletext,
-    vbi_page * page, gchar ** text)
+/* Makes the parts of row @row drawn at @dest that the page leaves
+ * transparent so, for overlaying subtitles on the video */
+static void
+gst_teletextdec_apply_opacity (const vbi_page * page, gint row, guint8 * dest,
+    gint rowstride)
 {
-  const gint line_length = page->columns;
-  gchar line[line_length + 1];
-  GString *subs;
-  gint length, i;
-
-  subs = g_string_new ("");
-  /* Print lines 2 to 23 */
-  for (i = 1; i < 23; i++) {
-    vbi_print_page_region (page, line, line_length + 1, "UTF-8", TRUE, 0,
-        0, i, page->columns, 1);
-    /* Add the null character */
-    line[line_length] = '\0';
-    /* Strip blank lines */
-    g_strstrip (line);
-    if (g_strcmp0 (line, "")) {
-      g_string_append_printf (subs, teletext->subtitles_template, line);
+  const vbi_char *ac = page->text + row * page->columns;
+  gint i, x, y;
+
+  for (i = 0; i < page->columns; i++, dest += GLYPH_WIDTH * 4) {
+    vbi_rgba bg = page->color_map[ac[i].background] & 0xFFFFFF;
+    guint8 alpha;
+    gboolean all;
+
+    switch (ac[i].opacity) {
+      case VBI_TRANSPARENT_SPACE:
+        alpha = 0;
+        all = TRUE;
+        break;
+      case VBI_TRANSPARENT_FULL:
+        alpha = 0;
+        all = FALSE;
+        break;
+      case VBI_SEMI_TRANSPARENT:
+        alpha = 0x80;
+        all = FALSE;
+        break;
+      default:
+        continue;
+    }
+
+    for (y = 0; y < GLYPH_HEIGHT; y++) {
+      guint8 *p = dest + y * rowstride;
+
+      for (x = 0; x < GLYPH_WIDTH; x++, p += 4) {
+        if (all || (p[0] | p[1] << 8 | p[2] << 16) == bg)
+          p[3] = alpha;
+      }
     }
   }
-  if (!g_strcmp0 (subs->str, ""))
-    g_string_append (subs, "\n");
+}
+
+/* Draws row @row of @page into the frame at @data */
+static void
+gst_teletextdec_draw_row (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page, gint row, guint8 * data,
+    gint rowstride)
+{
+  guint8 *dest = data + row * GLYPH_HEIGHT * rowstride;
+
+  if (teletext->renderer != GST_TELETEXTDEC_RENDERER_GLYPH_CACHE ||
+      !gst_teletextdec_draw_glyph_row (output, page, row, dest, rowstride))
+    vbi_draw_vt_page_region (page, VBI_PIXFMT_RGBA32_LE, dest, rowstride, 0,
+        row, page->columns, 1, FALSE, TRUE);
 
-  *text = subs->str;
-  length = subs->len + 1;
-  g_string_free (subs, FALSE);
-  return length;
+  if (teletext->subtitles_mode)
+    gst_teletextdec_apply_opacity (page, row, dest, rowstride);
 }
 
-static GstFlowReturn
-gst_teletextdec_export_text_page (GstTeletextDec * teletext, vbi_page * page,
-    GstBuffer ** buf)
+/* Draws the rows of @page into the frame at @data, only those that changed
+ * since @output drew its last page there if @incremental */
+static void
+gst_teletextdec_draw_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page, guint8 * data,
+    gint rowstride, gboolean incremental)
 {
-  GstCaps *caps;
-  GstFlowReturn ret;
-  gchar *text;
-  guint size;
+  gint row, redrawn;
+
+  if (incremental) {
+    redrawn = 0;
+    for (row = 0; row < page->rows; row++) {
+      if (!gst_teletextdec_row_changed (page, output->last_page, row))
+        continue;
+      gst_teletextdec_draw_row (teletext, output, page, row, data, rowstride);
+      redrawn++;
+    }
+    GST_DEBUG_OBJECT (teletext, "Redrew %d of %d rows", redrawn, page->rows);
+  } else {
+    GST_DEBUG_OBJECT (teletext, "Creating image with %d rows and %d cols",
+        page->rows, page->columns);
+    if (teletext->renderer == GST_TELETEXTDEC_RENDERER_ZVBI &&
+        !teletext->subtitles_mode) {
+      vbi_draw_vt_page_region (page, VBI_PIXFMT_RGBA32_LE, data, rowstride,
+          0, 0, page->columns, page->rows, FALSE, TRUE);
+    } else {
+      for (row = 0; row < page->rows; row++)
+        gst_teletextdec_draw_row (teletext, output, page, row, data,
+            rowstride);
+    }
+  }
 
-  if (teletext->subtitles_mode) {
-    size = gst_teletextdec_parse_subtitles_page (teletext, page, &text);
+  if (output->last_page == NULL)
+    output->last_page = g_new (vbi_page, 1);
+  memcpy (output->last_page, page, sizeof (vbi_page));
+}
+
+/* Picks the video caps of @output among what downstream accepts, as close
+ * as possible to the size the pages are drawn at */
+static gboolean
+gst_teletextdec_negotiate_video (GstTeletextDec * teletext,
+    GstTeletextOutput * output, gint width, gint height)
+{
+  GstCaps *caps, *peer_caps;
+  GstStructure *structure = NULL;
+  guint i;
+
+  peer_caps = gst_pad_peer_get_caps (output->pad);
+  if (peer_caps != NULL) {
+    caps = gst_caps_intersect (peer_caps,
+        gst_pad_get_pad_template_caps (output->pad));
+    gst_caps_unref (peer_caps);
   } else {
-    size = page->columns * page->rows;
-    text = g_malloc (size);
-    vbi_print_page (page, text, size, "UTF-8", FALSE, TRUE);
+    caps = gst_caps_copy (gst_pad_get_pad_template_caps (output->pad));
   }
 
-  /* Allocate new buffer */
-  caps = gst_caps_new_simple ("text/plain", NULL);
-  ret = gst_pad_alloc_buffer (teletext->srcpad, GST_BUFFER_OFFSET_NONE,
-      size, caps, &(*buf));
-  if (G_LIKELY (ret == GST_FLOW_OK))
-    GST_BUFFER_DATA (*buf) = GST_BUFFER_MALLOCDATA (*buf) = (guint8 *) text;
-  else
-    gst_buffer_unref (*buf);
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    structure = gst_caps_get_structure (caps, i);
+    if (g_str_has_prefix (gst_structure_get_name (structure), "video/"))
+      break;
+  }
+  if (i == gst_caps_get_size (caps)) {
+    gst_caps_unref (caps);
+    goto no_format;
+  }
 
+  output->video_caps = gst_caps_new_empty ();
+  gst_caps_append_structure (output->video_caps,
+      gst_structure_copy (structure));
   gst_caps_unref (caps);
-  return ret;
+
+  structure = gst_caps_get_structure (output->video_caps, 0);
+  gst_structure_fixate_field_nearest_int (structure, "width", width);
+  gst_structure_fixate_field_nearest_int (structure, "height", height);
+  gst_structure_fixate_field_nearest_fraction (structure, "framerate",
+      teletext->rate_numerator, teletext->rate_denominator);
+  gst_pad_fixate_caps (output->pad, output->video_caps);
+
+  if (!gst_video_format_parse_caps (output->video_caps, &output->video_format,
+          &output->width, &output->height)) {
+    gst_caps_unref (output->video_caps);
+    output->video_caps = NULL;
+    goto no_format;
+  }
+
+  output->page_width = width;
+  output->page_height = height;
+  gst_teletextdec_pool_set_caps (output->pool, output->video_caps);
+
+  GST_DEBUG_OBJECT (teletext, "Negotiated %" GST_PTR_FORMAT " on %s",
+      output->video_caps, GST_PAD_NAME (output->pad));
+
+  return TRUE;
+
+no_format:
+  {
+    GST_ERROR_OBJECT (teletext, "No video format accepted on %s",
+        GST_PAD_NAME (output->pad));
+    return FALSE;
+  }
 }
 
-static GstFlowReturn
-gst_teletextdec_export_html_page (GstTeletextDec * teletext, vbi_page * page,
-    GstBuffer ** buf)
+/* BT.601 with video levels */
+#define RGB_TO_Y(r,g,b) ((((66 * (r) + 129 * (g) + 25 * (b) + 128) >> 8)) + 16)
+#define RGB_TO_U(r,g,b) ((((-38 * (r) - 74 * (g) + 112 * (b) + 128) >> 8)) + 128)
+#define RGB_TO_V(r,g,b) ((((112 * (r) - 94 * (g) - 18 * (b) + 128) >> 8)) + 128)
+
+/* Scales the RGBA @canvas to the size of @output, nearest neighbour, and
+ * converts it into its video format at @data. Output lines showing the
+ * same canvas line are copied from the one above. */
+static void
+gst_teletextdec_convert_canvas (GstTeletextOutput * output,
+    const guint8 * canvas, gint canvas_width, gint canvas_height,
+    guint8 * data)
 {
-  GstCaps *caps;
-  GstFlowReturn ret;
-  gchar *html;
-  guint size;
-  vbi_export *ex;
-  gchar *err;
+  GstVideoFormat format = output->video_format;
+  gint width = output->width, height = output->height;
+  gint offset[4], stride[4];
+  const gint *xmap;
+  gint x, y, c, sy, last_sy = -1;
+
+  /* only computed again when negotiation changes the sizes */
+  if (output->xmap == NULL || output->xmap_width != width ||
+      output->xmap_canvas_width != canvas_width) {
+    g_free (output->xmap);
+    output->xmap = g_new (gint, width);
+    for (x = 0; x < width; x++)
+      output->xmap[x] = x * canvas_width / width * 4;
+    output->xmap_width = width;
+    output->xmap_canvas_width = canvas_width;
+  }
+  xmap = output->xmap;
 
-  if (!(ex = vbi_export_new ("html", &err))) {
-    GST_ELEMENT_ERROR (teletext, LIBRARY, SETTINGS,
-        ("Can't open the HTML export module: %s", err), (NULL));
-    g_free (err);
-    return GST_FLOW_ERROR;
+  for (c = 0; c < (format == GST_VIDEO_FORMAT_A420 ? 4 : 1); c++) {
+    offset[c] = gst_video_format_get_component_offset (format, c, width,
+        height);
+    stride[c] = gst_video_format_get_row_stride (format, c, width);
   }
 
-  /* export to NULL to get size of the memory needed to allocate the page */
-  size = vbi_export_mem (ex, NULL, 0, page);
-  if (size < 0)
-    return GST_FLOW_ERROR;
-  html = g_malloc (size);
-  vbi_export_mem (ex, html, size, page);
+  for (y = 0; y < height; y++) {
+    const guint8 *src;
+    guint8 *d;
 
-  /* Allocate new buffer */
-  caps = gst_caps_new_simple ("text/html", NULL);
-  ret = gst_pad_alloc_buffer (teletext->srcpad, GST_BUFFER_OFFSET_NONE,
-      size, caps, &(*buf));
-  if (G_LIKELY (ret == GST_FLOW_OK))
-    GST_BUFFER_DATA (*buf) = GST_BUFFER_MALLOCDATA (*buf) = (guint8 *) html;
+    sy = y * canvas_height / height;
+    src = canvas + sy * canvas_width * 4;
 
-  gst_caps_unref (caps);
-  return ret;
-}
+    if (format == GST_VIDEO_FORMAT_A420) {
+      guint8 *dy = data + offset[0] + y * stride[0];
+      guint8 *da = data + offset[3] + y * stride[3];
 
-static GstFlowReturn
-gst_teletextdec_export_rgba_page (GstTeletextDec * teletext, vbi_page * page,
-    GstBuffer ** buf)
-{
-  guint size;
-  GstCaps *caps, *out_caps;
-  GstFlowReturn ret;
-  gint width, height;
-  GstPadTemplate *templ;
+      if (sy == last_sy && (y & 1)) {
+        memcpy (dy, dy - stride[0], width);
+        memcpy (da, da - stride[3], width);
+        continue;
+      }
+      for (x = 0; x < width; x++) {
+        const guint8 *s = src + xmap[x];
 
-  /* one character occupies 12 x 10 pixels */
-  width = page->columns * 12;
-  height = page->rows * 10;
+        dy[x] = RGB_TO_Y (s[0], s[1], s[2]);
+        da[x] = s[3];
+      }
+      /* chroma from the top left pixel of each 2x2 block */
+      if (!(y & 1)) {
+        guint8 *du = data + offset[1] + (y / 2) * stride[1];
+        guint8 *dv = data + offset[2] + (y / 2) * stride[2];
 
-  caps = gst_caps_new_simple ("video/x-raw-rgb",
-      "width", G_TYPE_INT, width,
-      "height", G_TYPE_INT, height,
-      "framerate", GST_TYPE_FRACTION, teletext->rate_numerator,
-      teletext->rate_denominator, NULL);
+        for (x = 0; x < width; x += 2) {
+          const guint8 *s = src + xmap[x];
 
-  templ = gst_static_pad_template_get (&src_template);
-  out_caps = gst_caps_intersect (caps, gst_pad_template_get_caps (templ));
-  gst_caps_unref (caps);
-  gst_object_unref (templ);
+          du[x / 2] = RGB_TO_U (s[0], s[1], s[2]);
+          dv[x / 2] = RGB_TO_V (s[0], s[1], s[2]);
+        }
+      }
+      last_sy = sy;
+      continue;
+    }
 
-  size = (guint) width *(guint) height *sizeof (vbi_rgba);
+    d = data + y * stride[0];
+    if (sy == last_sy) {
+      memcpy (d, d - stride[0], width * 4);
+      continue;
+    }
+    last_sy = sy;
 
-  ret = gst_pad_alloc_buffer_and_set_caps (teletext->srcpad,
-      GST_BUFFER_OFFSET_NONE, size, out_caps, &(*buf));
+    switch (format) {
+      case GST_VIDEO_FORMAT_BGRA:
+        for (x = 0; x < width; x++, d += 4) {
+          const guint8 *s = src + xmap[x];
 
-  if (ret == GST_FLOW_OK) {
-    GST_DEBUG_OBJECT (teletext, "Creating image with %d rows and %d cols",
-        page->rows, page->columns);
-    vbi_draw_vt_page (page, VBI_PIXFMT_RGBA32_LE,
-        (vbi_rgba *) GST_BUFFER_DATA (*buf), FALSE, TRUE);
+          d[0] = s[2];
+          d[1] = s[1];
+          d[2] = s[0];
+          d[3] = s[3];
+        }
+        break;
+      case GST_VIDEO_FORMAT_AYUV:
+        for (x = 0; x < width; x++, d += 4) {
+          const guint8 *s = src + xmap[x];
+
+          d[0] = s[3];
+          d[1] = RGB_TO_Y (s[0], s[1], s[2]);
+          d[2] = RGB_TO_U (s[0], s[1], s[2]);
+          d[3] = RGB_TO_V (s[0], s[1], s[2]);
+        }
+        break;
+      default:
+        for (x = 0; x < width; x++, d += 4)
+          memcpy (d, src + xmap[x], 4);
+        break;
+    }
+  }
+}
+
+static GstFlowReturn
+gst_teletextdec_export_rgba_page (GstTeletextDec * teletext,
+    GstTeletextOutput * output, vbi_page * page, GstBuffer ** buf)
+{
+  guint size;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gint width, height, rowstride;
+  gboolean incremental;
+
+  width = page->columns * GLYPH_WIDTH;
+  height = page->rows * GLYPH_HEIGHT;
+  rowstride = width * sizeof (vbi_rgba);
+  size = (guint) rowstride *(guint) height;
+
+  /* caps are only picked again when the page size changes */
+  if (output->video_caps != NULL && (output->page_width != width ||
+          output->page_height != height)) {
+    gst_caps_unref (output->video_caps);
+    output->video_caps = NULL;
+  }
+  if (output->video_caps == NULL &&
+      !gst_teletextdec_negotiate_video (teletext, output, width, height))
+    return GST_FLOW_NOT_NEGOTIATED;
+
+  if (output->video_format != GST_VIDEO_FORMAT_RGBA ||
+      output->width != width || output->height != height) {
+    /* draw at the page size, then scale and convert the whole frame */
+    incremental = output->canvas != NULL && output->canvas_size == size &&
+        gst_teletextdec_page_layout_equal (output->last_page, page);
+    if (!incremental) {
+      g_free (output->canvas);
+      output->canvas = g_malloc (size);
+      output->canvas_size = size;
+    }
+    gst_teletextdec_draw_page (teletext, output, page, output->canvas,
+        rowstride, incremental);
+
+    *buf = gst_teletextdec_pool_acquire (output->pool,
+        gst_video_format_get_size (output->video_format, output->width,
+            output->height));
+    gst_teletextdec_convert_canvas (output, output->canvas, width, height,
+        GST_BUFFER_DATA (*buf));
+    return GST_FLOW_OK;
+  }
+
+  /* Retransmissions mostly differ in a row or two from the last page drawn
+   * on this pad, so start from the last frame and only redraw the rows that
+   * changed. */
+  incremental = output->last_frame != NULL &&
+      GST_BUFFER_SIZE (output->last_frame) == size &&
+      gst_teletextdec_page_layout_equal (output->last_page, page);
+
+  if (incremental && gst_buffer_is_writable (output->last_frame)) {
+    /* downstream is done with the last frame, draw into it again */
+    *buf = gst_buffer_ref (output->last_frame);
+  } else {
+    *buf = gst_teletextdec_pool_acquire (output->pool, size);
+    if (incremental)
+      memcpy (GST_BUFFER_DATA (*buf), GST_BUFFER_DATA (output->last_frame),
+          size);
+
+    if (output->last_frame != NULL)
+      gst_buffer_unref (output->last_frame);
+    output->last_frame = gst_buffer_ref (*buf);
   }
 
-  gst_caps_unref (out_caps);
+  gst_teletextdec_draw_page (teletext, output, page, GST_BUFFER_DATA (*buf),
+      rowstride, incremental);
+
   return ret;
 }
 
 static gboolean
-gst_teletextdec_push_preroll_buffer (GstTeletextDec * teletext)
+gst_teletextdec_push_preroll_buffer (GstTeletextDec * teletext, GstPad * pad)
 {
   GstFlowReturn ret;
   GstBuffer *buf;
@@ -922,8 +3719,12 @@ gst_teletextdec_push_preroll_buffer (GstTeletextDec * teletext)
   GstCaps *out_caps, *peer_caps, *pad_caps;
 
   /* the stream is sparse, we send a dummy buffer for preroll */
-  peer_caps = gst_pad_peer_get_caps (teletext->srcpad);
-  pad_caps = gst_pad_get_caps (teletext->srcpad);
+  peer_caps = gst_pad_peer_get_caps (pad);
+  if (peer_caps == NULL) {
+    /* nothing linked to this pad yet */
+    return TRUE;
+  }
+  pad_caps = gst_pad_get_caps (pad);
   out_caps = gst_caps_intersect (pad_caps, peer_caps);
 
   if (gst_caps_is_empty (out_caps)) {
@@ -933,14 +3734,14 @@ gst_teletextdec_push_preroll_buffer (GstTeletextDec * teletext)
 
   structure = gst_caps_get_structure (out_caps, 0);
   mimetype = gst_structure_get_name (structure);
-  if (g_strcmp0 (mimetype, "video/x-raw-rgb") == 0) {
-    /* omit preroll buffer for this format */
+  if (g_str_has_prefix (mimetype, "video/")) {
+    /* omit preroll buffer for the video formats */
     goto beach;
   }
 
   buf = gst_buffer_new ();
   gst_buffer_set_caps (buf, out_caps);
-  ret = gst_pad_push (teletext->srcpad, buf);
+  ret = gst_pad_push (pad, buf);
   if (ret != GST_FLOW_OK)
     res = FALSE;
 
@@ -991,6 +3792,7 @@ gst_teletextdec_line_address (GstTeletextDec * teletext,
   if (G_UNLIKELY (frame->current_slice >= frame->sliced_end)) {
     GST_LOG_OBJECT (teletext, "Out of sliced VBI buffer space (%d lines).",
         (int) (frame->sliced_end - frame->sliced_begin));
+    teletext->stats.units_no_slice++;
     return VBI_ERROR;
   }
 
@@ -1013,18 +3815,123 @@ gst_teletextdec_line_address (GstTeletextDec * teletext,
     (*spp)->line = frame_line;
   } else {
     /* Undefined line. */
+    teletext->stats.units_bad_line++;
     return VBI_ERROR;
   }
 
   return VBI_SUCCESS;
 }
 
-static gboolean
+#define SWAR_ONES G_GUINT64_CONSTANT (0x0101010101010101)
+
+/* Bit-reverses the 42 bytes of a teletext data unit from transmission order
+ * into @dest, eight bytes at a time, and returns how many of the received
+ * bytes have even parity. */
+static guint
+gst_teletextdec_reverse_payload (guint8 * dest, const guint8 * src)
+{
+  guint64 x, p;
+  guint errors = 0;
+  guint i;
+
+  for (i = 0; i + 8 <= 42; i += 8) {
+    memcpy (&x, src + i, 8);
+
+    /* fold the parity of each byte into its lowest bit and count the bytes
+     * where it is clear */
+    p = x ^ (x >> 4);
+    p ^= p >> 2;
+    p ^= p >> 1;
+    p &= SWAR_ONES;
+    errors += 8 - (guint) ((p * SWAR_ONES) >> 56);
+
+    x = ((x >> 1) & G_GUINT64_CONSTANT (0x5555555555555555)) |
+        ((x & G_GUINT64_CONSTANT (0x5555555555555555)) << 1);
+    x = ((x >> 2) & G_GUINT64_CONSTANT (0x3333333333333333)) |
+        ((x & G_GUINT64_CONSTANT (0x3333333333333333)) << 2);
+    x = ((x >> 4) & G_GUINT64_CONSTANT (0x0f0f0f0f0f0f0f0f)) |
+        ((x & G_GUINT64_CONSTANT (0x0f0f0f0f0f0f0f0f)) << 4);
+    memcpy (dest + i, &x, 8);
+  }
+  for (; i < 42; i++) {
+    if (vbi_unpar8 (src[i]) < 0)
+      errors++;
+    dest[i] = vbi_rev8 (src[i]);
+  }
+
+  return errors;
+}
+
+/* Checks a bit-reversed teletext packet. Returns the number of parity errors
+ * in its text bytes or -1 if the packet address can't be decoded */
+static gint
+gst_teletextdec_check_packet (const guint8 * data, guint parity_errors)
+{
+  gint mrag;
+
+  mrag = vbi_unham16p (data);
+  if (mrag < 0)
+    return -1;
+
+  /* all bytes of packets 0 to 25 have odd parity, the later packets are
+   * Hamming 24/18 coded */
+  if ((mrag >> 3) > 25)
+    return 0;
+
+  return parity_errors;
+}
+
+#define DATA_UNIT_SIZE 46
+#define DATA_UNIT_LENGTH 0x2C
+#define FRAMING_CODE 0xE4
+
+/* Returns the offset of the first teletext data unit after @offset in
+ * @packet, found by its id, length and framing code, or @size if there is
+ * none */
+static guint
+gst_teletextdec_find_data_unit (const guint8 * packet, guint offset,
+    guint size)
+{
+  const guint8 *p = packet + offset + 1;
+  const guint8 *end = packet + size;
+
+  /* look for the length byte, the rarest of the three */
+  while (end - p > 2) {
+    p = memchr (p, DATA_UNIT_LENGTH, end - p - 2);
+    if (p == NULL)
+      break;
+    if ((p[-1] == DATA_UNIT_EBU_TELETEXT_NON_SUBTITLE ||
+            p[-1] == DATA_UNIT_EBU_TELETEXT_SUBTITLE) && p[2] == FRAMING_CODE)
+      return p - 1 - packet;
+    p++;
+  }
+
+  return size;
+}
+
+/* Skips the damaged data unit at @offset up to the next teletext data
+ * unit */
+static guint
+gst_teletextdec_resync (GstTeletextDec * teletext, const guint8 * packet,
+    guint offset, guint size)
+{
+  guint next = gst_teletextdec_find_data_unit (packet, offset, size);
+
+  GST_LOG_OBJECT (teletext, "Skipping %u bytes of damaged data units",
+      next - offset);
+  teletext->stats.bytes_skipped += next - offset;
+
+  return next;
+}
+
+/* Parses the data units from @offset on into @f, up to the end of @packet
+ * or the first line of the next frame. Damaged data units are skipped and
+ * only cost the lines they carry. */
+static gint
 gst_teletextdec_extract_data_units (GstTeletextDec * teletext,
     GstTeletextFrame * f, guint8 * packet, guint * offset, gint size)
 {
   guint8 *data_unit;
-  guint i;
 
   while (*offset < size) {
     vbi_sliced *s = NULL;
@@ -1032,65 +3939,84 @@ gst_teletextdec_extract_data_units (GstTeletextDec * teletext,
 
     data_unit = packet + *offset;
     data_unit_id = data_unit[0];
-    data_unit_length = data_unit[1];
-    GST_LOG_OBJECT (teletext, "vbi header %02x %02x %02x\n", data_unit[0],
-        data_unit[1], data_unit[2]);
+    data_unit_length = *offset + 1 < size ? data_unit[1] : -1;
 
     switch (data_unit_id) {
       case DATA_UNIT_STUFFING:
       {
-        *offset += 1;
+        /* a stuffing data unit or stuffing bytes */
+        if (data_unit_length == DATA_UNIT_LENGTH &&
+            *offset + DATA_UNIT_SIZE <= size)
+          *offset += DATA_UNIT_SIZE;
+        else
+          *offset += 1;
         break;
       }
 
       case DATA_UNIT_EBU_TELETEXT_NON_SUBTITLE:
       case DATA_UNIT_EBU_TELETEXT_SUBTITLE:
       {
-        gint res;
+        gint res, errors;
+        guint field_line;
 
-        if (G_UNLIKELY (data_unit_length != 1 + 1 + 42)) {
-          /* Skip this data unit */
+        if (G_UNLIKELY (data_unit_length != DATA_UNIT_LENGTH ||
+                *offset + DATA_UNIT_SIZE > size)) {
           GST_WARNING_OBJECT (teletext, "The data unit length is not 44 bytes");
+          teletext->stats.units_bad_length++;
+          *offset = gst_teletextdec_resync (teletext, packet, *offset, size);
+          break;
+        }
+
+        /* teletext is carried on lines 7 to 22 of each field */
+        field_line = data_unit[2] & 31;
+        if (G_UNLIKELY (field_line < 7 || field_line > 22)) {
+          GST_LOG_OBJECT (teletext, "Bad line: %u", field_line);
+          teletext->stats.units_bad_line++;
+          *offset += DATA_UNIT_SIZE;
           break;
         }
 
         res =
             gst_teletextdec_line_address (teletext, f, &s, data_unit[2],
             SYSTEM_625);
+        if (res == VBI_NEW_FRAME) {
+          /* New frame */
+          return VBI_NEW_FRAME;
+        }
+        *offset += DATA_UNIT_SIZE;
         if (G_UNLIKELY (res == VBI_ERROR)) {
-          /* Can't retrieve line address, skip this data unit */
           GST_WARNING_OBJECT (teletext,
               "Could not retrieve line address for this data unit");
-          return VBI_ERROR;
-        }
-        if (G_UNLIKELY (f->last_field_line > 0
-                && (f->last_field_line - 7 >= 23 - 7))) {
-          GST_WARNING_OBJECT (teletext, "Bad line: %d", f->last_field_line - 7);
-          return VBI_ERROR;
+          break;
         }
-        if (res == VBI_NEW_FRAME) {
-          /* New frame */
-          return VBI_NEW_FRAME;
+        teletext->stats.units_parsed++;
+
+        errors = gst_teletextdec_reverse_payload (s->data, data_unit + 4);
+        errors = gst_teletextdec_check_packet (s->data, errors);
+        if (G_UNLIKELY (errors < 0 || (teletext->max_parity_errors >= 0
+                    && errors > teletext->max_parity_errors))) {
+          /* don't hand corrupt lines to the decoder */
+          f->current_slice--;
+          f->dropped_lines++;
+          teletext->stats.units_parity++;
+          break;
         }
+        f->parity_errors += errors;
         s->id = VBI_SLICED_TELETEXT_B;
-        for (i = 0; i < 42; i++)
-          s->data[i] = vbi_rev8 (data_unit[4 + i]);
-        *offset += 46;
         break;
       }
 
       default:
       {
-        /* HACK: In some cases, the data unit is 1 byte smaller making all
-         * the following data units invalids. we try to fix this manually */
-        if ((data_unit[-1] == DATA_UNIT_EBU_TELETEXT_NON_SUBTITLE ||
-                data_unit[-1] == DATA_UNIT_EBU_TELETEXT_SUBTITLE) &&
-            data_unit[0] == 44) {
-          GST_LOG_OBJECT (teletext, "Corrected data unit");
-          *offset -= 1;
-        } else {
-          *offset += data_unit_length + 2;
-        }
+        /* other data units are skipped, ids reserved for future use mean
+         * we lost track of the data units */
+        if ((data_unit_id >= 0x80 ||
+                data_unit_id == DATA_UNIT_EBU_TELETEXT_INVERTED) &&
+            data_unit_length >= 0 &&
+            *offset + 2 + data_unit_length <= size)
+          *offset += 2 + data_unit_length;
+        else
+          *offset = gst_teletextdec_resync (teletext, packet, *offset, size);
         break;
       }
     }
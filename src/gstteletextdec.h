@@ -22,6 +22,7 @@
 #define __GST_TELETEXTDEC_H__
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 #include <libzvbi.h>
 
 G_BEGIN_DECLS
@@ -38,7 +39,14 @@ G_BEGIN_DECLS
 typedef struct _GstTeletextDec GstTeletextDec;
 typedef struct _GstTeletextDecClass GstTeletextDecClass;
 typedef struct _GstTeletextFrame GstTeletextFrame;
+typedef struct _GstTeletextOutput GstTeletextOutput;
+typedef struct _GstTeletextPageInfo GstTeletextPageInfo;
+typedef struct _GstTeletextStats GstTeletextStats;
+typedef struct _GstTeletextBuffer GstTeletextBuffer;
+typedef struct _GstTeletextBufferPool GstTeletextBufferPool;
 typedef enum _GstTeletextOutputFormat GstTeletextOutputFormat;
+typedef enum _GstTeletextDecLeaky GstTeletextDecLeaky;
+typedef enum _GstTeletextDecRenderer GstTeletextDecRenderer;
 
 enum _GstTeletextOutputFormat
 {
@@ -48,6 +56,83 @@ enum _GstTeletextOutputFormat
   GST_TELETEXTDEC_OUTPUT_FORMAT_SUBTITLES
 };
 
+/* Which pages are dropped when the page queue is full */
+enum _GstTeletextDecLeaky
+{
+  GST_TELETEXTDEC_LEAKY_NO,
+  GST_TELETEXTDEC_LEAKY_UPSTREAM,
+  GST_TELETEXTDEC_LEAKY_DOWNSTREAM
+};
+
+/* How RGBA pages are drawn */
+enum _GstTeletextDecRenderer
+{
+  GST_TELETEXTDEC_RENDERER_ZVBI,
+  GST_TELETEXTDEC_RENDERER_GLYPH_CACHE
+};
+
+/* Slot of the queue of received pages */
+struct _GstTeletextPageInfo
+{
+  gint pgno;
+  gint subno;
+  /* of the input buffer the page was completed in */
+  GstClockTime timestamp;
+  GstClockTime duration;
+};
+
+#define GST_TELETEXTDEC_N_OUTPUT_FORMATS \
+  (GST_TELETEXTDEC_OUTPUT_FORMAT_SUBTITLES + 1)
+#define GST_TELETEXTDEC_N_EXPORT_BUCKETS 8
+
+/* Decoder counters. The data unit counters only cover private/teletext
+ * input, PES input is parsed by the zvbi demuxer. pages_pushed and
+ * export_time are counted by whichever thread exports, the others by the
+ * streaming thread. */
+struct _GstTeletextStats
+{
+  guint64 units_parsed;
+  guint64 units_bad_length;
+  guint64 units_bad_line;
+  guint64 units_no_slice;
+  guint64 units_parity;
+  guint64 bytes_skipped;
+  guint64 frames_decoded;
+  guint64 lines_filtered;
+  guint64 resyncs_avoided;
+  guint64 pages_received;
+  guint64 pages_dropped;
+  guint64 pages_pushed;
+
+  /* Export durations per output format */
+  guint64 export_time[GST_TELETEXTDEC_N_OUTPUT_FORMATS]
+      [GST_TELETEXTDEC_N_EXPORT_BUCKETS];
+};
+
+/* Output buffer that goes back to its pool when downstream releases it */
+struct _GstTeletextBuffer
+{
+  GstBuffer buffer;
+
+  GstTeletextBufferPool *pool;
+  /* allocated size of the data, GST_BUFFER_SIZE is the size used */
+  guint capacity;
+};
+
+/* Buffers of one pad with the caps negotiated on it, kept for reuse when
+ * downstream releases them until the caps change. Referenced by the pad
+ * and by every buffer handed out, as those may be released after the pad
+ * is gone. */
+struct _GstTeletextBufferPool
+{
+  volatile gint refcount;
+  GMutex *lock;
+  GstCaps *caps;
+  GSList *free;
+  guint n_free;
+  gboolean active;
+};
+
 typedef void (*GstTeletextProcessBufferFunc) (GstTeletextDec *
     teletext, GstBuffer * buf);
 
@@ -66,22 +151,167 @@ struct _GstTeletextDec
   /* Props */
   gint pageno;
   gint subno;
+  /* Set with the object lock when page or subpage change */
+  gboolean page_changed;
   gboolean subtitles_mode;
   gchar *subtitles_template;
+  /* subtitles_template split around its %s */
+  gchar *subtitles_prefix;
+  gchar *subtitles_suffix;
+  gint max_parity_errors;
+  gboolean deduplicate;
+  gboolean subtitles_change_only;
+  guint max_queue_size;
+  GstTeletextDecLeaky leaky;
+  GstTeletextDecRenderer renderer;
+  gboolean page_filter;
+  guint max_cache_pages;
+  gchar *cache_page_set;
+  guint stats_interval;
+  guint export_threads;
+  gchar *cache_file;
+  guint cache_save_interval;
+
+  GstSegment segment;
 
   vbi_dvb_demux *demux;
   vbi_decoder *decoder;
   vbi_export *exporter;
-  GQueue *queue;
-  GMutex *queue_lock;
+  GMutex *exporter_lock;
+
+  /* Ring of received pages, drained on every chain call. The zvbi event
+   * handler runs from process_buf_func on the streaming thread; it advances
+   * queue_tail, and queue_head only to drop the oldest page. Both are free
+   * running and accessed atomically as the stats read them from other
+   * threads. */
+  GstTeletextPageInfo *queue;
+  volatile gint queue_head;
+  volatile gint queue_tail;
 
   GstTeletextFrame *frame;
-  float last_ts;
-  GstTeletextOutputFormat output_format;
+
+  /* Lines passed by the page filter, and whether the page being sent in
+   * each magazine is kept */
+  vbi_sliced *filtered;
+  guint filtered_size;
+  gboolean magazine_kept[8];
+
+  /* Pages of cache-page-set and pages let into the decoder so far, by page
+   * number - 0x100 */
+  guint8 cache_pages[0x800 / 8];
+  guint8 pages_admitted[0x800 / 8];
+  guint n_pages_admitted;
+
+  /* Subpages the decoder received, which it keeps until it is deleted, by
+   * page number - 0x100 and subpage number & 0x7F, which covers the
+   * subpages 00 to 79 */
+  guint8 cached_subpages[0x800][0x80 / 8];
+  volatile gint n_cached_subpages;
+
+  /* sample time of the last frame decoded, in seconds */
+  gdouble last_ts;
+
+  /* Counters of the streaming thread, only touched there. They are copied
+   * to published_stats at the end of every input buffer. */
+  GstTeletextStats stats;
+  /* Copy of stats and the export counters, read for the stats property */
+  GMutex *stats_lock;
+  GstTeletextStats published_stats;
+  GstClockTime last_stats_post;
+
+  /* Pages saved to the cache file by an earlier run, sorted by page number
+   * and served until the network turns out to be a different one */
+  GMappedFile *snapshot;
+  guint n_snapshot_pages;
+  guint snapshot_cni;
+  gboolean snapshot_served;
+  guint network_cni;
+  /* Pages received since the last save, by page number - 0x100 */
+  guint8 pages_dirty[0x800 / 8];
+  GstClockTime last_cache_save;
+  /* Header and pages of the last save, which the next one copies the pages
+   * not received again from. cache_thread writes it to cache_image_file
+   * and clears cache_writing when done. */
+  gpointer cache_image;
+  gchar *cache_image_file;
+  GThread *cache_thread;
+  volatile gint cache_writing;
+
+  /* Pages are exported on this pool when export-threads is set and pushed
+   * in the order they were fetched in. export_done holds the finished jobs
+   * sorted by sequence number. */
+  GThreadPool *export_pool;
+  GMutex *export_lock;
+  GCond *export_cond;
+  guint64 export_seqnum;
+  guint64 export_push_seqnum;
+  GList *export_done;
+  gboolean export_pushing;
+  GstFlowReturn export_ret;
+
+  /* GstTeletextOutput for the always and the requested source pads */
+  GList *outputs;
 
   GstTeletextProcessBufferFunc process_buf_func;
 };
 
+struct _GstTeletextOutput
+{
+  GstPad *pad;
+
+  /* Page shown on a requested pad, the always pad uses the properties */
+  gint pageno;
+  gint subno;
+
+  GstTeletextOutputFormat output_format;
+
+  /* Output buffers, with the caps of output_format */
+  GstTeletextBufferPool *pool;
+
+  /* Serializes the exports for this pad on the export pool */
+  GMutex *lock;
+
+  /* Reused for the subtitles text */
+  GString *text;
+
+  /* Character cells drawn by zvbi, to copy them into the RGBA frames, and
+   * the page they are drawn on */
+  GHashTable *glyphs;
+  vbi_page *glyph_page;
+
+  /* Video format and size negotiated with downstream, and the page size
+   * they were picked for */
+  GstCaps *video_caps;
+  GstVideoFormat video_format;
+  gint width;
+  gint height;
+  gint page_width;
+  gint page_height;
+
+  /* Page drawn at its own size, when it has to be converted for the video
+   * format */
+  guint8 *canvas;
+  gsize canvas_size;
+  /* Canvas offsets of the output columns, for the widths they were
+   * computed for */
+  gint *xmap;
+  gint xmap_width;
+  gint xmap_canvas_width;
+
+  /* Last RGBA frame and the page drawn into it */
+  GstBuffer *last_frame;
+  vbi_page *last_page;
+
+  /* Content hash of the last page pushed, for deduplication */
+  guint64 last_hash;
+  gboolean has_hash;
+
+  /* Subtitle held back until the text changes, and the end of the last
+   * repeat of it */
+  GstBuffer *held;
+  GstClockTime held_stop;
+};
+
 struct _GstTeletextFrame
 {
   vbi_sliced *sliced_begin;
@@ -91,6 +321,14 @@ struct _GstTeletextFrame
   guint last_field;
   guint last_field_line;
   guint last_frame_line;
+
+  /* Timestamp of the buffer the frame started in, plus a frame period per
+   * frame started before it in that buffer */
+  GstClockTime timestamp;
+
+  /* Parity errors in the kept lines and corrupt lines dropped */
+  guint parity_errors;
+  guint dropped_lines;
 };
 
 
@@ -0,0 +1,638 @@
+/*
+ * GStreamer
+ * Copyright (C) 2009 Sebastian <sebp@k-d-w.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:element-teletextsrc
+ *
+ * Generate a synthetic EBU teletext stream, either as PES packets or as
+ * private/teletext payloads, for load generation and testing of teletextdec.
+ *
+ * Every frame carries 15 teletext lines. The magazines of the carousel are
+ * transmitted in parallel, and the subtitle page is sent whenever its text
+ * changes and once per second. All pages are encoded up front, so
+ * generating a frame is mostly copying.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch -v teletextsrc magazines=8 pages=50 num-buffers=10000 ! teletextdec page=888 subtitles-mode=TRUE ! text/plain ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <string.h>
+
+#include "gstteletextsrc.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_teletextsrc_debug);
+#define GST_CAT_DEFAULT gst_teletextsrc_debug
+
+#define PACKETS_PER_PAGE 24
+#define DATA_UNIT_SIZE 46
+#define LINES_PER_FRAME 15
+/* PES header padded so that a packet fills four transport stream packets */
+#define PES_HEADER_SIZE 45
+#define FRAME_DURATION (GST_SECOND / 25)
+
+#define DATA_IDENTIFIER_EBU 0x10
+#define DATA_UNIT_EBU_TELETEXT_NON_SUBTITLE 0x02
+#define DATA_UNIT_EBU_TELETEXT_SUBTITLE 0x03
+#define DATA_UNIT_STUFFING 0xFF
+#define FRAMING_CODE 0xE4
+
+/* page header control bits */
+#define CONTROL_ERASE_PAGE (1 << 0)
+#define CONTROL_SUBTITLE (1 << 2)
+#define CONTROL_SUPPRESS_HEADER (1 << 3)
+
+#define DEFAULT_MAGAZINES 8
+#define DEFAULT_PAGES 10
+#define DEFAULT_ROTATION_RATE 1.0
+#define DEFAULT_SUBTITLE_PAGE 888
+#define DEFAULT_SUBTITLE_DURATION 2000
+#define DEFAULT_CORRUPTION 0.0
+
+enum
+{
+  PROP_0,
+  PROP_MAGAZINES,
+  PROP_PAGES,
+  PROP_ROTATION_RATE,
+  PROP_SUBTITLE_PAGE,
+  PROP_SUBTITLE_DURATION,
+  PROP_CORRUPTION
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS
+    ("video/mpeg,mpegversion=2,systemstream=TRUE ; private/teletext")
+    );
+
+/* debug category for filtering log messages */
+#define DEBUG_INIT(bla) \
+  GST_DEBUG_CATEGORY_INIT (gst_teletextsrc_debug, "teletextsrc", 0, "Teletext source");
+
+GST_BOILERPLATE_FULL (GstTeletextSrc, gst_teletextsrc, GstPushSrc,
+    GST_TYPE_PUSH_SRC, DEBUG_INIT);
+
+static void gst_teletextsrc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_teletextsrc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+
+static gboolean gst_teletextsrc_start (GstBaseSrc * basesrc);
+static gboolean gst_teletextsrc_stop (GstBaseSrc * basesrc);
+static gboolean gst_teletextsrc_set_caps (GstBaseSrc * basesrc, GstCaps * caps);
+static gboolean gst_teletextsrc_is_seekable (GstBaseSrc * basesrc);
+static GstFlowReturn gst_teletextsrc_create (GstPushSrc * pushsrc,
+    GstBuffer ** buf);
+
+/* GObject vmethod implementations */
+
+static void
+gst_teletextsrc_base_init (gpointer klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_set_details_simple (element_class,
+      "Teletext source",
+      "Source",
+      "Generate a synthetic EBU teletext PES stream",
+      "Sebastian Pölsterl <sebp@k-d-w.org>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+}
+
+static void
+gst_teletextsrc_class_init (GstTeletextSrcClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstBaseSrcClass *gstbasesrc_class;
+  GstPushSrcClass *gstpushsrc_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->set_property = gst_teletextsrc_set_property;
+  gobject_class->get_property = gst_teletextsrc_get_property;
+
+  gstbasesrc_class = GST_BASE_SRC_CLASS (klass);
+  gstbasesrc_class->start = GST_DEBUG_FUNCPTR (gst_teletextsrc_start);
+  gstbasesrc_class->stop = GST_DEBUG_FUNCPTR (gst_teletextsrc_stop);
+  gstbasesrc_class->set_caps = GST_DEBUG_FUNCPTR (gst_teletextsrc_set_caps);
+  gstbasesrc_class->is_seekable =
+      GST_DEBUG_FUNCPTR (gst_teletextsrc_is_seekable);
+
+  gstpushsrc_class = GST_PUSH_SRC_CLASS (klass);
+  gstpushsrc_class->create = GST_DEBUG_FUNCPTR (gst_teletextsrc_create);
+
+  g_object_class_install_property (gobject_class, PROP_MAGAZINES,
+      g_param_spec_int ("magazines", "Magazines",
+          "Number of magazines in the carousel, starting with magazine 1",
+          1, 8, DEFAULT_MAGAZINES, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_PAGES,
+      g_param_spec_int ("pages", "Pages",
+          "Number of pages in each magazine", 1, 100, DEFAULT_PAGES,
+          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_ROTATION_RATE,
+      g_param_spec_double ("rotation-rate", "Rotation rate",
+          "How many times per second the content of the pages changes "
+          "(0 for static pages)", 0.0, 25.0, DEFAULT_ROTATION_RATE,
+          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_SUBTITLE_PAGE,
+      g_param_spec_int ("subtitle-page", "Subtitle page",
+          "Number of the subtitle page, 100 to 899 (0 for none)", 0, 899,
+          DEFAULT_SUBTITLE_PAGE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_SUBTITLE_DURATION,
+      g_param_spec_uint ("subtitle-duration", "Subtitle duration",
+          "Milliseconds each subtitle or gap between subtitles is shown",
+          40, G_MAXUINT, DEFAULT_SUBTITLE_DURATION, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_CORRUPTION,
+      g_param_spec_double ("corruption", "Corruption",
+          "Fraction of teletext lines to corrupt", 0.0, 1.0,
+          DEFAULT_CORRUPTION, G_PARAM_READWRITE));
+}
+
+static void
+gst_teletextsrc_init (GstTeletextSrc * src, GstTeletextSrcClass * klass)
+{
+  src->magazines = DEFAULT_MAGAZINES;
+  src->pages = DEFAULT_PAGES;
+  src->rotation_rate = DEFAULT_ROTATION_RATE;
+  src->subtitle_pageno = (gint) vbi_bin2bcd (DEFAULT_SUBTITLE_PAGE);
+  src->subtitle_duration = DEFAULT_SUBTITLE_DURATION;
+  src->corruption = DEFAULT_CORRUPTION;
+
+  src->pes_output = TRUE;
+  src->units = NULL;
+  src->subtitle_units = NULL;
+  src->rand = NULL;
+
+  gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
+}
+
+static void
+gst_teletextsrc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstTeletextSrc *src = GST_TELETEXTSRC (object);
+
+  switch (prop_id) {
+    case PROP_MAGAZINES:
+      src->magazines = g_value_get_int (value);
+      break;
+    case PROP_PAGES:
+      src->pages = g_value_get_int (value);
+      break;
+    case PROP_ROTATION_RATE:
+      src->rotation_rate = g_value_get_double (value);
+      break;
+    case PROP_SUBTITLE_PAGE:
+    {
+      gint pageno = g_value_get_int (value);
+
+      /* 1 to 99 are no page numbers */
+      if (pageno != 0 && pageno < 100) {
+        GST_WARNING_OBJECT (src, "Ignoring invalid subtitle page %d", pageno);
+        break;
+      }
+      src->subtitle_pageno = (gint) vbi_bin2bcd (pageno);
+      break;
+    }
+    case PROP_SUBTITLE_DURATION:
+      src->subtitle_duration = g_value_get_uint (value);
+      break;
+    case PROP_CORRUPTION:
+      src->corruption = g_value_get_double (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_teletextsrc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstTeletextSrc *src = GST_TELETEXTSRC (object);
+
+  switch (prop_id) {
+    case PROP_MAGAZINES:
+      g_value_set_int (value, src->magazines);
+      break;
+    case PROP_PAGES:
+      g_value_set_int (value, src->pages);
+      break;
+    case PROP_ROTATION_RATE:
+      g_value_set_double (value, src->rotation_rate);
+      break;
+    case PROP_SUBTITLE_PAGE:
+      g_value_set_int (value, (gint) vbi_bcd2dec (src->subtitle_pageno));
+      break;
+    case PROP_SUBTITLE_DURATION:
+      g_value_set_uint (value, src->subtitle_duration);
+      break;
+    case PROP_CORRUPTION:
+      g_value_set_double (value, src->corruption);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Encodes packet @packet of magazine @magazine with the 40 bytes @data into
+ * the EBU data unit @unit, in transmission bit order. The line offset is
+ * filled in when the unit is sent. */
+static void
+gst_teletextsrc_encode_unit (guint8 * unit, guint8 data_unit_id,
+    gint magazine, gint packet, const guint8 * data)
+{
+  gint i;
+
+  unit[0] = data_unit_id;
+  unit[1] = DATA_UNIT_SIZE - 2;
+  unit[2] = 0xC0;
+  unit[3] = FRAMING_CODE;
+  unit[4] = vbi_rev8 (vbi_ham8 ((magazine & 7) | ((packet & 1) << 3)));
+  unit[5] = vbi_rev8 (vbi_ham8 (packet >> 1));
+  for (i = 0; i < 40; i++)
+    unit[6 + i] = vbi_rev8 (data[i]);
+}
+
+static void
+gst_teletextsrc_encode_text (guint8 * data, const gchar * text, gint size)
+{
+  gint i;
+
+  for (i = 0; i < size && text[i] != '\0'; i++)
+    data[i] = vbi_par8 (text[i]);
+  for (; i < size; i++)
+    data[i] = vbi_par8 (' ');
+}
+
+/* Encodes a page header for page @pgno in BCD with subcode 0 */
+static void
+gst_teletextsrc_encode_header (guint8 * unit, guint8 data_unit_id, gint pgno,
+    guint control, const gchar * text)
+{
+  guint8 data[40];
+
+  data[0] = vbi_ham8 (pgno & 0xF);
+  data[1] = vbi_ham8 ((pgno >> 4) & 0xF);
+  data[2] = vbi_ham8 (0);
+  data[3] = vbi_ham8 ((control & CONTROL_ERASE_PAGE) ? 0x8 : 0);
+  data[4] = vbi_ham8 (0);
+  data[5] = vbi_ham8 (((control >> 1) & 0x3) << 2);
+  data[6] = vbi_ham8 ((control >> 3) & 0xF);
+  data[7] = vbi_ham8 ((control >> 7) & 0xF);
+  gst_teletextsrc_encode_text (data + 8, text, 32);
+
+  gst_teletextsrc_encode_unit (unit, data_unit_id, (pgno >> 8) & 7, 0, data);
+}
+
+static void
+gst_teletextsrc_encode_row (guint8 * unit, guint8 data_unit_id, gint pgno,
+    gint row, const gchar * text)
+{
+  guint8 data[40];
+
+  gst_teletextsrc_encode_text (data, text, 40);
+  gst_teletextsrc_encode_unit (unit, data_unit_id, (pgno >> 8) & 7, row,
+      data);
+}
+
+static gint
+gst_teletextsrc_carousel_pgno (GstTeletextSrc * src, gint magazine, gint page)
+{
+  return (magazine << 8) | ((page / 10) << 4) | (page % 10);
+}
+
+static guint8 *
+gst_teletextsrc_carousel_units (GstTeletextSrc * src, gint magazine,
+    gint page)
+{
+  return src->units +
+      ((magazine - 1) * src->pages + page) * PACKETS_PER_PAGE * DATA_UNIT_SIZE;
+}
+
+/* Rewrites the row that changes with every rotation of the carousel */
+static void
+gst_teletextsrc_rotate (GstTeletextSrc * src)
+{
+  gchar text[41];
+  gint magazine, page;
+
+  g_snprintf (text, sizeof (text), "  Update %010u", src->generation);
+
+  for (magazine = 1; magazine <= src->magazines; magazine++) {
+    for (page = 0; page < src->pages; page++) {
+      gst_teletextsrc_encode_row (gst_teletextsrc_carousel_units (src,
+              magazine, page) + DATA_UNIT_SIZE,
+          DATA_UNIT_EBU_TELETEXT_NON_SUBTITLE,
+          gst_teletextsrc_carousel_pgno (src, magazine, page), 1, text);
+    }
+  }
+}
+
+static void
+gst_teletextsrc_encode_carousel (GstTeletextSrc * src)
+{
+  gchar text[41];
+  gint magazine, page, row;
+
+  src->units = g_malloc (src->magazines * src->pages * PACKETS_PER_PAGE *
+      DATA_UNIT_SIZE);
+
+  for (magazine = 1; magazine <= src->magazines; magazine++) {
+    for (page = 0; page < src->pages; page++) {
+      gint pgno = gst_teletextsrc_carousel_pgno (src, magazine, page);
+      guint8 *unit = gst_teletextsrc_carousel_units (src, magazine, page);
+
+      g_snprintf (text, sizeof (text), "teletextsrc %03x", pgno);
+      gst_teletextsrc_encode_header (unit, DATA_UNIT_EBU_TELETEXT_NON_SUBTITLE,
+          pgno, 0, text);
+
+      for (row = 2; row < PACKETS_PER_PAGE; row++) {
+        g_snprintf (text, sizeof (text),
+            "  Synthetic page %03x row %02d          ", pgno, row);
+        gst_teletextsrc_encode_row (unit + row * DATA_UNIT_SIZE,
+            DATA_UNIT_EBU_TELETEXT_NON_SUBTITLE, pgno, row, text);
+      }
+    }
+  }
+
+  src->generation = 0;
+  gst_teletextsrc_rotate (src);
+}
+
+/* Encodes the subtitle page, which alternates between a boxed line of text
+ * and an empty page */
+static void
+gst_teletextsrc_encode_subtitle (GstTeletextSrc * src)
+{
+  gchar text[41];
+  gint pgno = src->subtitle_pageno;
+
+  gst_teletextsrc_encode_header (src->subtitle_units,
+      DATA_UNIT_EBU_TELETEXT_SUBTITLE, pgno,
+      CONTROL_ERASE_PAGE | CONTROL_SUBTITLE | CONTROL_SUPPRESS_HEADER, "");
+  src->n_subtitle_units = 1;
+
+  if (src->subtitle_index % 2 == 0) {
+    /* start box twice, then the text, then end box twice */
+    g_snprintf (text, sizeof (text), "      \x0b\x0bSubtitle %u\x0a\x0a",
+        src->subtitle_index / 2);
+    gst_teletextsrc_encode_row (src->subtitle_units + DATA_UNIT_SIZE,
+        DATA_UNIT_EBU_TELETEXT_SUBTITLE, pgno, 22, text);
+    src->n_subtitle_units++;
+  }
+
+  src->subtitle_pending = TRUE;
+}
+
+static gboolean
+gst_teletextsrc_start (GstBaseSrc * basesrc)
+{
+  GstTeletextSrc *src = GST_TELETEXTSRC (basesrc);
+  gint i;
+
+  gst_teletextsrc_encode_carousel (src);
+
+  src->subtitle_units = g_malloc (2 * DATA_UNIT_SIZE);
+  src->n_subtitle_units = 0;
+  src->subtitle_index = 0;
+  src->subtitle_pending = FALSE;
+  if (src->subtitle_pageno != 0)
+    gst_teletextsrc_encode_subtitle (src);
+
+  for (i = 0; i < 8; i++) {
+    src->magazine[i].units = NULL;
+    src->magazine[i].n_units = 0;
+    src->magazine[i].next_unit = 0;
+    src->magazine[i].page = -1;
+  }
+  src->next_magazine = 1;
+
+  src->n_frames = 0;
+  src->rand = g_rand_new_with_seed (0);
+
+  return TRUE;
+}
+
+static gboolean
+gst_teletextsrc_stop (GstBaseSrc * basesrc)
+{
+  GstTeletextSrc *src = GST_TELETEXTSRC (basesrc);
+
+  g_free (src->units);
+  src->units = NULL;
+  g_free (src->subtitle_units);
+  src->subtitle_units = NULL;
+  if (src->rand != NULL) {
+    g_rand_free (src->rand);
+    src->rand = NULL;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_teletextsrc_set_caps (GstBaseSrc * basesrc, GstCaps * caps)
+{
+  GstTeletextSrc *src = GST_TELETEXTSRC (basesrc);
+  GstStructure *structure = gst_caps_get_structure (caps, 0);
+
+  src->pes_output = gst_structure_has_name (structure, "video/mpeg");
+  GST_DEBUG_OBJECT (src, "Generating %s", src->pes_output ? "PES packets" :
+      "private/teletext");
+
+  return TRUE;
+}
+
+static gboolean
+gst_teletextsrc_is_seekable (GstBaseSrc * basesrc)
+{
+  return FALSE;
+}
+
+/* Moves magazine @index (magazine 8 is 0) on to the next page to send */
+static void
+gst_teletextsrc_next_page (GstTeletextSrc * src, gint index)
+{
+  GstTeletextSrcMagazine *m = &src->magazine[index];
+  gint magazine = index == 0 ? 8 : index;
+
+  m->next_unit = 0;
+
+  if (src->subtitle_pending && ((src->subtitle_pageno >> 8) & 7) == index) {
+    m->units = src->subtitle_units;
+    m->n_units = src->n_subtitle_units;
+    src->subtitle_pending = FALSE;
+    return;
+  }
+
+  if (magazine > src->magazines) {
+    m->units = NULL;
+    m->n_units = 0;
+    return;
+  }
+
+  m->page = (m->page + 1) % src->pages;
+  if (src->pages > 1 && gst_teletextsrc_carousel_pgno (src, magazine,
+          m->page) == src->subtitle_pageno)
+    m->page = (m->page + 1) % src->pages;
+
+  m->units = gst_teletextsrc_carousel_units (src, magazine, m->page);
+  m->n_units = PACKETS_PER_PAGE;
+}
+
+/* Returns the next data unit to send, with the magazines taking turns */
+static const guint8 *
+gst_teletextsrc_next_unit (GstTeletextSrc * src)
+{
+  static const guint8 stuffing[DATA_UNIT_SIZE] = {
+    DATA_UNIT_STUFFING, DATA_UNIT_SIZE - 2, 0xFF, 0xFF
+  };
+  gint i;
+
+  for (i = 0; i < 8; i++) {
+    gint index = src->next_magazine;
+    GstTeletextSrcMagazine *m = &src->magazine[index];
+
+    src->next_magazine = (index + 1) % 8;
+
+    if (m->next_unit >= m->n_units)
+      gst_teletextsrc_next_page (src, index);
+    if (m->n_units == 0)
+      continue;
+
+    return m->units + (m->next_unit++) * DATA_UNIT_SIZE;
+  }
+
+  return stuffing;
+}
+
+static void
+gst_teletextsrc_write_pts (guint8 * data, guint64 pts)
+{
+  data[0] = 0x21 | ((pts >> 29) & 0x0E);
+  data[1] = (pts >> 22) & 0xFF;
+  data[2] = 0x01 | ((pts >> 14) & 0xFE);
+  data[3] = (pts >> 7) & 0xFF;
+  data[4] = 0x01 | ((pts << 1) & 0xFE);
+}
+
+static GstFlowReturn
+gst_teletextsrc_create (GstPushSrc * pushsrc, GstBuffer ** buf)
+{
+  GstTeletextSrc *src = GST_TELETEXTSRC (pushsrc);
+  GstClockTime timestamp;
+  guint8 *data;
+  guint size, line;
+  guint generation;
+
+  timestamp = src->n_frames * FRAME_DURATION;
+
+  generation = (guint) (src->n_frames * src->rotation_rate / 25);
+  if (generation != src->generation) {
+    src->generation = generation;
+    gst_teletextsrc_rotate (src);
+  }
+
+  if (src->subtitle_pageno != 0) {
+    gint index = (gint) (timestamp / (src->subtitle_duration * GST_MSECOND));
+
+    if (index != src->subtitle_index) {
+      src->subtitle_index = index;
+      gst_teletextsrc_encode_subtitle (src);
+    } else if (src->n_frames % 25 == 0) {
+      /* repeat the current subtitle once per second */
+      src->subtitle_pending = TRUE;
+    }
+  }
+
+  size = 1 + LINES_PER_FRAME * DATA_UNIT_SIZE;
+  if (src->pes_output)
+    size += PES_HEADER_SIZE;
+
+  *buf = gst_buffer_new_and_alloc (size);
+  data = GST_BUFFER_DATA (*buf);
+
+  if (src->pes_output) {
+    data[0] = 0x00;
+    data[1] = 0x00;
+    data[2] = 0x01;
+    data[3] = 0xBD;
+    GST_WRITE_UINT16_BE (data + 4, size - 6);
+    /* data alignment, PTS only, fixed header length */
+    data[6] = 0x84;
+    data[7] = 0x80;
+    data[8] = PES_HEADER_SIZE - 9;
+    gst_teletextsrc_write_pts (data + 9,
+        gst_util_uint64_scale (timestamp, 90000, GST_SECOND));
+    memset (data + 14, 0xFF, PES_HEADER_SIZE - 14);
+    data += PES_HEADER_SIZE;
+  }
+
+  *data++ = DATA_IDENTIFIER_EBU;
+
+  for (line = 0; line < LINES_PER_FRAME; line++) {
+    /* lines 7 to 14 of the first field and 7 to 13 of the second */
+    guint first_field = line < 8;
+    guint line_offset = first_field ? 7 + line : line - 1;
+
+    memcpy (data, gst_teletextsrc_next_unit (src), DATA_UNIT_SIZE);
+    if (data[0] != DATA_UNIT_STUFFING)
+      data[2] = 0xC0 | (first_field << 5) | line_offset;
+
+    if (G_UNLIKELY (src->corruption > 0.0 &&
+            g_rand_double (src->rand) < src->corruption)) {
+      gint i;
+
+      for (i = 0; i < 4; i++)
+        data[4 + g_rand_int_range (src->rand, 0, 42)] = g_rand_int (src->rand);
+    }
+
+    data += DATA_UNIT_SIZE;
+  }
+
+  GST_BUFFER_TIMESTAMP (*buf) = timestamp;
+  GST_BUFFER_DURATION (*buf) = FRAME_DURATION;
+  GST_BUFFER_OFFSET (*buf) = src->n_frames;
+  GST_BUFFER_OFFSET_END (*buf) = src->n_frames + 1;
+  gst_buffer_set_caps (*buf, GST_PAD_CAPS (GST_BASE_SRC_PAD (src)));
+
+  src->n_frames++;
+
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,91 @@
+/*
+ * GStreamer
+ * Copyright (C) 2009 Sebastian <sebp@k-d-w.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __GST_TELETEXTSRC_H__
+#define __GST_TELETEXTSRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+#include <libzvbi.h>
+
+G_BEGIN_DECLS
+#define GST_TYPE_TELETEXTSRC \
+  (gst_teletextsrc_get_type())
+#define GST_TELETEXTSRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_TELETEXTSRC,GstTeletextSrc))
+#define GST_TELETEXTSRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_TELETEXTSRC,GstTeletextSrcClass))
+#define GST_IS_TELETEXTSRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_TELETEXTSRC))
+#define GST_IS_TELETEXTSRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_TELETEXTSRC))
+typedef struct _GstTeletextSrc GstTeletextSrc;
+typedef struct _GstTeletextSrcClass GstTeletextSrcClass;
+typedef struct _GstTeletextSrcMagazine GstTeletextSrcMagazine;
+
+struct _GstTeletextSrcMagazine
+{
+  /* Data units of the page being transmitted */
+  const guint8 *units;
+  guint n_units;
+  guint next_unit;
+
+  gint page;
+};
+
+struct _GstTeletextSrc
+{
+  GstPushSrc parent;
+
+  /* Props */
+  gint magazines;
+  gint pages;
+  gdouble rotation_rate;
+  gint subtitle_pageno;
+  guint subtitle_duration;
+  gdouble corruption;
+
+  gboolean pes_output;
+  guint64 n_frames;
+
+  /* Pre-encoded data units of all carousel pages */
+  guint8 *units;
+  guint generation;
+
+  guint8 *subtitle_units;
+  guint n_subtitle_units;
+  gint subtitle_index;
+  gboolean subtitle_pending;
+
+  GstTeletextSrcMagazine magazine[8];
+  gint next_magazine;
+
+  GRand *rand;
+};
+
+struct _GstTeletextSrcClass
+{
+  GstPushSrcClass parent_class;
+};
+
+GType gst_teletextsrc_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_TELETEXTSRC_H__ */
@@ -0,0 +1,1010 @@
+/*
+ * GStreamer
+ * Copyright (C) 2009 Sebastian <sebp@k-d-w.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:element-teletexttsdec
+ *
+ * Decode the teletext of every service of an MPEG transport stream.
+ *
+ * The teletext PIDs are found through the PAT and PMTs. The PES packets of
+ * each of them are decoded by a teletextdec in the bin, whose src pad is
+ * exposed as a src_%d sometimes pad named after the PID. The selected page
+ * is output in any format teletextdec negotiates. With the threads property
+ * set, the PIDs are decoded in parallel on a thread pool.
+ *
+ * The upstream segment is passed on in time. Buffers are timestamped from
+ * their PTS, from the time of the first PTS after the segment on.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch -v filesrc location=mux.ts ! teletexttsdec name=d threads=4 page=888 subtitles-mode=TRUE d.src_%d ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <string.h>
+
+#include "gstteletexttsdec.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_teletexttsdec_debug);
+#define GST_CAT_DEFAULT gst_teletexttsdec_debug
+
+#define PACKET_SIZE GST_TELETEXTTSDEC_PACKET_SIZE
+#define SYNC_BYTE 0x47
+#define PAT_PID 0x0000
+#define PID_NULL 0x1FFF
+
+#define TABLE_ID_PAT 0x00
+#define TABLE_ID_PMT 0x02
+#define STREAM_TYPE_PRIVATE_PES 0x06
+#define DESCRIPTOR_TELETEXT 0x56
+
+#define PES_HEADER_SIZE 6
+#define PTS_CLOCK_RATE 90000
+/* the PTS are 33 bits and wrap around after about 26.5 hours */
+#define PTS_WRAP (G_GINT64_CONSTANT (1) << 33)
+
+/* PES packets and events handed to the pool but not pushed yet */
+#define MAX_PENDING 64
+
+enum
+{
+  PROP_0,
+  PROP_PAGENO,
+  PROP_SUBNO,
+  PROP_SUBTITLES_MODE,
+  PROP_THREADS
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts, systemstream = (boolean) true")
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%d",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_RGBA "; " GST_VIDEO_CAPS_BGRA "; "
+        GST_VIDEO_CAPS_YUV ("AYUV") "; " GST_VIDEO_CAPS_YUV ("A420")
+        "; text/plain ; text/html")
+    );
+
+/* debug category for filtering log messages */
+#define DEBUG_INIT(bla) \
+  GST_DEBUG_CATEGORY_INIT (gst_teletexttsdec_debug, "teletexttsdec", 0, "Teletext transport stream decoder");
+
+GST_BOILERPLATE_FULL (GstTeletextTsDec, gst_teletexttsdec, GstBin,
+    GST_TYPE_BIN, DEBUG_INIT);
+
+static void gst_teletexttsdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_teletexttsdec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_teletexttsdec_finalize (GObject * object);
+
+static GstStateChangeReturn gst_teletexttsdec_change_state (GstElement *
+    element, GstStateChange transition);
+
+static GstFlowReturn gst_teletexttsdec_chain (GstPad * pad, GstBuffer * buf);
+static gboolean gst_teletexttsdec_sink_event (GstPad * pad, GstEvent * event);
+
+static void gst_teletexttsdec_push_func (gpointer data, gpointer user_data);
+static void gst_teletexttsdec_clear (GstTeletextTsDec * tsdec);
+
+/* GObject vmethod implementations */
+
+static void
+gst_teletexttsdec_base_init (gpointer klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_set_details_simple (element_class,
+      "Teletext transport stream decoder",
+      "Codec/Demuxer",
+      "Decode the teletext of all services of an MPEG transport stream to "
+      "RGBA, HTML and text",
+      "Sebastian Pölsterl <sebp@k-d-w.org>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+}
+
+static void
+gst_teletexttsdec_class_init (GstTeletextTsDecClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->set_property = gst_teletexttsdec_set_property;
+  gobject_class->get_property = gst_teletexttsdec_get_property;
+  gobject_class->finalize = gst_teletexttsdec_finalize;
+
+  gstelement_class = GST_ELEMENT_CLASS (klass);
+  gstelement_class->change_state = gst_teletexttsdec_change_state;
+
+  g_object_class_install_property (gobject_class, PROP_PAGENO,
+      g_param_spec_int ("page", "Page number",
+          "Number of page that should displayed",
+          100, 999, 100, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_SUBNO,
+      g_param_spec_int ("subpage", "Sub-page number",
+          "Number of sub-page that should displayed (-1 for all)",
+          -1, 0x99, -1, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_SUBTITLES_MODE,
+      g_param_spec_boolean ("subtitles-mode", "Enable subtitles mode",
+          "Enables subtitles mode for text output stripping the blank lines and "
+          "the teletext state lines", FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Number of threads decoding the teletext streams, 0 to decode them "
+          "on the streaming thread. Takes effect when going to PAUSED",
+          0, 64, 0, G_PARAM_READWRITE));
+}
+
+static void
+gst_teletexttsdec_init (GstTeletextTsDec * tsdec, GstTeletextTsDecClass * klass)
+{
+  tsdec->sinkpad = gst_pad_new_from_static_template (&sink_template, "sink");
+  gst_pad_set_chain_function (tsdec->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_teletexttsdec_chain));
+  gst_pad_set_event_function (tsdec->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_teletexttsdec_sink_event));
+  gst_element_add_pad (GST_ELEMENT (tsdec), tsdec->sinkpad);
+
+  tsdec->pageno = 100;
+  tsdec->subno = -1;
+  tsdec->subtitles_mode = FALSE;
+  tsdec->threads = 0;
+
+  tsdec->residue_size = 0;
+  tsdec->sections = g_new0 (GstTeletextTsDecSection *,
+      GST_TELETEXTTSDEC_N_PIDS);
+  tsdec->sections[PAT_PID] = g_new0 (GstTeletextTsDecSection, 1);
+  tsdec->sections[PAT_PID]->version = -1;
+  tsdec->pid_streams = g_new0 (GstTeletextTsDecStream *,
+      GST_TELETEXTTSDEC_N_PIDS);
+  tsdec->streams = NULL;
+  tsdec->n_pmts = 0;
+  tsdec->n_pmts_parsed = 0;
+  tsdec->pads_complete = FALSE;
+  gst_segment_init (&tsdec->segment, GST_FORMAT_UNDEFINED);
+  tsdec->in_timestamp = GST_CLOCK_TIME_NONE;
+  tsdec->base_pts = -1;
+  tsdec->base_time = 0;
+
+  tsdec->pool = NULL;
+  tsdec->lock = g_mutex_new ();
+  tsdec->cond = g_cond_new ();
+  tsdec->n_pending = 0;
+}
+
+static void
+gst_teletexttsdec_finalize (GObject * object)
+{
+  GstTeletextTsDec *tsdec = GST_TELETEXTTSDEC (object);
+  gint i;
+
+  for (i = 0; i < GST_TELETEXTTSDEC_N_PIDS; i++)
+    g_free (tsdec->sections[i]);
+  g_free (tsdec->sections);
+  g_free (tsdec->pid_streams);
+  g_mutex_free (tsdec->lock);
+  g_cond_free (tsdec->cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+/* Sets a property of the decoders to the one of the same name of @tsdec */
+static void
+gst_teletexttsdec_forward_property (GstTeletextTsDec * tsdec,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstIterator *it = gst_bin_iterate_elements (GST_BIN (tsdec));
+  gboolean done = FALSE;
+  gpointer item;
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item)) {
+      case GST_ITERATOR_OK:
+        g_object_set_property (G_OBJECT (item), pspec->name, value);
+        gst_object_unref (item);
+        break;
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync (it);
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+  gst_iterator_free (it);
+}
+
+static void
+gst_teletexttsdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstTeletextTsDec *tsdec = GST_TELETEXTTSDEC (object);
+
+  switch (prop_id) {
+    case PROP_PAGENO:
+      tsdec->pageno = g_value_get_int (value);
+      gst_teletexttsdec_forward_property (tsdec, value, pspec);
+      break;
+    case PROP_SUBNO:
+      tsdec->subno = g_value_get_int (value);
+      gst_teletexttsdec_forward_property (tsdec, value, pspec);
+      break;
+    case PROP_SUBTITLES_MODE:
+      tsdec->subtitles_mode = g_value_get_boolean (value);
+      gst_teletexttsdec_forward_property (tsdec, value, pspec);
+      break;
+    case PROP_THREADS:
+      tsdec->threads = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_teletexttsdec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstTeletextTsDec *tsdec = GST_TELETEXTTSDEC (object);
+
+  switch (prop_id) {
+    case PROP_PAGENO:
+      g_value_set_int (value, tsdec->pageno);
+      break;
+    case PROP_SUBNO:
+      g_value_set_int (value, tsdec->subno);
+      break;
+    case PROP_SUBTITLES_MODE:
+      g_value_set_boolean (value, tsdec->subtitles_mode);
+      break;
+    case PROP_THREADS:
+      g_value_set_uint (value, tsdec->threads);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Waits until the pool pushed everything queued */
+static void
+gst_teletexttsdec_drain (GstTeletextTsDec * tsdec)
+{
+  if (tsdec->pool == NULL)
+    return;
+
+  g_mutex_lock (tsdec->lock);
+  while (tsdec->n_pending > 0)
+    g_cond_wait (tsdec->cond, tsdec->lock);
+  g_mutex_unlock (tsdec->lock);
+}
+
+/* Pushes @obj, a PES packet or an event, to the decoder of @stream */
+static void
+gst_teletexttsdec_push (GstTeletextTsDecStream * stream, GstMiniObject * obj)
+{
+  GstTeletextTsDec *tsdec = stream->tsdec;
+  GstFlowReturn ret;
+
+  if (GST_IS_EVENT (obj)) {
+    gst_pad_push_event (stream->feedpad, GST_EVENT_CAST (obj));
+    return;
+  }
+
+  ret = gst_pad_push (stream->feedpad, GST_BUFFER_CAST (obj));
+
+  /* read by the chain function while workers push */
+  g_mutex_lock (tsdec->lock);
+  stream->last_ret = ret;
+  g_mutex_unlock (tsdec->lock);
+}
+
+/* Runs on the pool. Pushes what is queued on a stream, while the chain
+ * function may queue more. */
+static void
+gst_teletexttsdec_push_func (gpointer data, gpointer user_data)
+{
+  GstTeletextTsDecStream *stream = (GstTeletextTsDecStream *) data;
+  GstTeletextTsDec *tsdec = GST_TELETEXTTSDEC (user_data);
+  GstMiniObject *obj;
+
+  g_mutex_lock (tsdec->lock);
+  while ((obj = g_queue_pop_head (&stream->pending)) != NULL) {
+    g_mutex_unlock (tsdec->lock);
+
+    gst_teletexttsdec_push (stream, obj);
+
+    g_mutex_lock (tsdec->lock);
+    tsdec->n_pending--;
+    g_cond_broadcast (tsdec->cond);
+  }
+  stream->scheduled = FALSE;
+  g_mutex_unlock (tsdec->lock);
+}
+
+/* Hands @obj to the pool to be pushed to the decoder of @stream, or pushes
+ * it right away without a pool */
+static void
+gst_teletexttsdec_queue (GstTeletextTsDec * tsdec,
+    GstTeletextTsDecStream * stream, GstMiniObject * obj)
+{
+  if (tsdec->pool == NULL) {
+    gst_teletexttsdec_push (stream, obj);
+    return;
+  }
+
+  g_mutex_lock (tsdec->lock);
+  while (tsdec->n_pending >= MAX_PENDING)
+    g_cond_wait (tsdec->cond, tsdec->lock);
+
+  g_queue_push_tail (&stream->pending, obj);
+  tsdec->n_pending++;
+  /* a stream is only on the pool once, so its packets are pushed in
+   * order by one worker at a time */
+  if (!stream->scheduled) {
+    stream->scheduled = TRUE;
+    g_thread_pool_push (tsdec->pool, stream, NULL);
+  }
+  g_mutex_unlock (tsdec->lock);
+}
+
+/* Pushes @event to the decoders of all streams, taking its reference */
+static gboolean
+gst_teletexttsdec_push_event (GstTeletextTsDec * tsdec, GstEvent * event)
+{
+  gboolean ret = TRUE;
+  GList *l;
+
+  for (l = tsdec->streams; l != NULL; l = l->next) {
+    GstTeletextTsDecStream *stream = (GstTeletextTsDecStream *) l->data;
+
+    ret &= gst_pad_push_event (stream->feedpad, gst_event_ref (event));
+  }
+  gst_event_unref (event);
+
+  return ret;
+}
+
+/* Returns the upstream segment converted to time. A segment in another
+ * format starts at the first PTS after it, and so does its stream time
+ * unless the stream is played from its start. */
+static GstEvent *
+gst_teletexttsdec_new_segment (GstTeletextTsDec * tsdec)
+{
+  GstSegment *segment = &tsdec->segment;
+  gint64 position = 0;
+
+  if (segment->format == GST_FORMAT_TIME) {
+    return gst_event_new_new_segment_full (FALSE, segment->rate,
+        segment->applied_rate, GST_FORMAT_TIME, segment->start,
+        segment->stop, segment->time);
+  }
+
+  if (segment->start > 0 && tsdec->base_pts != -1) {
+    position = gst_util_uint64_scale (tsdec->base_pts % PTS_WRAP, GST_SECOND,
+        PTS_CLOCK_RATE);
+  }
+
+  return gst_event_new_new_segment_full (FALSE, segment->rate,
+      segment->applied_rate, GST_FORMAT_TIME, 0, -1, position);
+}
+
+/* Returns the timestamp of the PES packet in @data from its PTS, or
+ * GST_CLOCK_TIME_NONE */
+static GstClockTime
+gst_teletexttsdec_pes_timestamp (GstTeletextTsDec * tsdec,
+    GstTeletextTsDecStream * stream, const guint8 * data, guint size)
+{
+  gint64 pts, last;
+
+  if (size < 14 || (GST_READ_UINT32_BE (data) >> 8) != 0x000001 ||
+      !(data[7] & 0x80))
+    return GST_CLOCK_TIME_NONE;
+
+  pts = (gint64) (data[9] & 0x0E) << 29 |
+      (GST_READ_UINT16_BE (data + 10) >> 1) << 15 |
+      GST_READ_UINT16_BE (data + 12) >> 1;
+
+  /* unwrap to the value closest to the last PTS of the PID, or to the base
+   * for its first */
+  last = stream->last_pts != -1 ? stream->last_pts : tsdec->base_pts;
+  if (last != -1) {
+    while (pts - last > PTS_WRAP / 2)
+      pts -= PTS_WRAP;
+    while (last - pts > PTS_WRAP / 2)
+      pts += PTS_WRAP;
+  }
+  stream->last_pts = pts;
+
+  if (tsdec->base_pts == -1) {
+    tsdec->base_pts = pts;
+    /* in time the PTS follow the input timestamps */
+    if (tsdec->segment.format != GST_FORMAT_TIME)
+      tsdec->base_time = 0;
+    else if (GST_CLOCK_TIME_IS_VALID (tsdec->in_timestamp))
+      tsdec->base_time = tsdec->in_timestamp;
+    else
+      tsdec->base_time = tsdec->segment.start;
+  }
+
+  /* before the base, on a PID that started late */
+  if (pts < tsdec->base_pts)
+    return GST_CLOCK_TIME_NONE;
+
+  return tsdec->base_time + gst_util_uint64_scale (pts - tsdec->base_pts,
+      GST_SECOND, PTS_CLOCK_RATE);
+}
+
+/* Hands the first @size bytes collected for @stream, a PES packet, to its
+ * decoder and drops the rest */
+static void
+gst_teletexttsdec_push_pes (GstTeletextTsDec * tsdec,
+    GstTeletextTsDecStream * stream, guint size)
+{
+  GstBuffer *buf;
+
+  buf = gst_buffer_new_and_alloc (size);
+  memcpy (GST_BUFFER_DATA (buf), stream->collect->data, size);
+  g_byte_array_set_size (stream->collect, 0);
+  GST_BUFFER_TIMESTAMP (buf) = gst_teletexttsdec_pes_timestamp (tsdec, stream,
+      GST_BUFFER_DATA (buf), size);
+  gst_buffer_set_caps (buf, GST_PAD_CAPS (stream->feedpad));
+
+  /* after the timestamp, which may set the base the segment starts at */
+  if (stream->need_segment) {
+    gst_teletexttsdec_queue (tsdec, stream,
+        GST_MINI_OBJECT_CAST (gst_teletexttsdec_new_segment (tsdec)));
+    stream->need_segment = FALSE;
+  }
+
+  gst_teletexttsdec_queue (tsdec, stream, GST_MINI_OBJECT_CAST (buf));
+}
+
+/* Restarts the timestamps at the next PTS */
+static void
+gst_teletexttsdec_reset_time (GstTeletextTsDec * tsdec)
+{
+  GList *l;
+
+  tsdec->base_pts = -1;
+  for (l = tsdec->streams; l != NULL; l = l->next) {
+    GstTeletextTsDecStream *stream = (GstTeletextTsDecStream *) l->data;
+
+    stream->last_pts = -1;
+    stream->need_segment = TRUE;
+  }
+}
+
+static gboolean
+gst_teletexttsdec_sink_event (GstPad * pad, GstEvent * event)
+{
+  GstTeletextTsDec *tsdec = GST_TELETEXTTSDEC (gst_pad_get_parent (pad));
+  gboolean ret;
+  GList *l;
+
+  GST_DEBUG_OBJECT (tsdec, "got event %s",
+      gst_event_type_get_name (GST_EVENT_TYPE (event)));
+
+  /* keep events in order with the packets still being pushed */
+  if (GST_EVENT_IS_SERIALIZED (event))
+    gst_teletexttsdec_drain (tsdec);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_NEWSEGMENT:
+    {
+      gboolean update;
+      gdouble rate, applied_rate;
+      GstFormat format;
+      gint64 start, stop, position;
+
+      /* converted and sent to the decoders with their next packet */
+      gst_event_parse_new_segment_full (event, &update, &rate, &applied_rate,
+          &format, &start, &stop, &position);
+      gst_segment_set_newsegment_full (&tsdec->segment, update, rate,
+          applied_rate, format, start, stop, position);
+      if (update) {
+        for (l = tsdec->streams; l != NULL; l = l->next)
+          ((GstTeletextTsDecStream *) l->data)->need_segment = TRUE;
+      } else {
+        gst_teletexttsdec_reset_time (tsdec);
+      }
+      gst_event_unref (event);
+      ret = TRUE;
+      break;
+    }
+    case GST_EVENT_FLUSH_STOP:
+      tsdec->residue_size = 0;
+      gst_segment_init (&tsdec->segment, GST_FORMAT_UNDEFINED);
+      gst_teletexttsdec_reset_time (tsdec);
+      for (l = tsdec->streams; l != NULL; l = l->next) {
+        GstTeletextTsDecStream *stream = (GstTeletextTsDecStream *) l->data;
+
+        g_byte_array_set_size (stream->collect, 0);
+        g_mutex_lock (tsdec->lock);
+        stream->last_ret = GST_FLOW_OK;
+        g_mutex_unlock (tsdec->lock);
+      }
+      ret = gst_teletexttsdec_push_event (tsdec, event);
+      break;
+    case GST_EVENT_EOS:
+      if (tsdec->streams == NULL) {
+        GST_ELEMENT_ERROR (tsdec, STREAM, DEMUX, (NULL),
+            ("No teletext stream found"));
+        gst_event_unref (event);
+        ret = FALSE;
+        break;
+      }
+      /* PES packets without a length end here */
+      for (l = tsdec->streams; l != NULL; l = l->next) {
+        GstTeletextTsDecStream *stream = (GstTeletextTsDecStream *) l->data;
+
+        if (stream->collect->len > 0)
+          gst_teletexttsdec_push_pes (tsdec, stream, stream->collect->len);
+      }
+      gst_teletexttsdec_drain (tsdec);
+      ret = gst_teletexttsdec_push_event (tsdec, event);
+      break;
+    default:
+      ret = gst_teletexttsdec_push_event (tsdec, event);
+      break;
+  }
+
+  gst_object_unref (tsdec);
+
+  return ret;
+}
+
+static GstStateChangeReturn
+gst_teletexttsdec_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstStateChangeReturn ret;
+  GstTeletextTsDec *tsdec = GST_TELETEXTTSDEC (element);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      tsdec->n_pending = 0;
+      if (tsdec->threads > 0) {
+        tsdec->pool = g_thread_pool_new (gst_teletexttsdec_push_func, tsdec,
+            tsdec->threads, FALSE, NULL);
+      }
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_teletexttsdec_drain (tsdec);
+      if (tsdec->pool != NULL) {
+        g_thread_pool_free (tsdec->pool, FALSE, TRUE);
+        tsdec->pool = NULL;
+      }
+      gst_teletexttsdec_clear (tsdec);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static GstTeletextTsDecStream *
+gst_teletexttsdec_add_stream (GstTeletextTsDec * tsdec, guint16 pid)
+{
+  GstTeletextTsDecStream *stream;
+  GstElement *decoder;
+  GstPad *pad;
+  GstCaps *caps;
+  gchar *name;
+
+  GST_INFO_OBJECT (tsdec, "Found teletext stream on PID %u", pid);
+
+  name = g_strdup_printf ("decoder_%u", pid);
+  decoder = gst_element_factory_make ("teletextdec", name);
+  g_free (name);
+  if (decoder == NULL) {
+    GST_ELEMENT_ERROR (tsdec, CORE, MISSING_PLUGIN, (NULL),
+        ("Could not create a teletextdec element"));
+    return NULL;
+  }
+  g_object_set (decoder, "page", tsdec->pageno, "subpage", tsdec->subno,
+      "subtitles-mode", tsdec->subtitles_mode, NULL);
+  gst_bin_add (GST_BIN (tsdec), decoder);
+
+  stream = g_new0 (GstTeletextTsDecStream, 1);
+  stream->tsdec = tsdec;
+  stream->pid = pid;
+  stream->decoder = decoder;
+  stream->need_segment = TRUE;
+  stream->collect = g_byte_array_new ();
+  stream->last_pts = -1;
+  g_queue_init (&stream->pending);
+  stream->scheduled = FALSE;
+  stream->last_ret = GST_FLOW_OK;
+
+  stream->feedpad = gst_pad_new ("feed", GST_PAD_SRC);
+  caps = gst_caps_new_simple ("video/mpeg", "mpegversion", G_TYPE_INT, 2,
+      "systemstream", G_TYPE_BOOLEAN, TRUE, NULL);
+  gst_pad_set_caps (stream->feedpad, caps);
+  gst_caps_unref (caps);
+  pad = gst_element_get_static_pad (decoder, "sink");
+  gst_pad_link (stream->feedpad, pad);
+  gst_object_unref (pad);
+  gst_pad_set_active (stream->feedpad, TRUE);
+
+  gst_element_sync_state_with_parent (decoder);
+
+  name = g_strdup_printf ("src_%u", pid);
+  pad = gst_element_get_static_pad (decoder, "src");
+  stream->srcpad = gst_ghost_pad_new_from_template (name, pad,
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (tsdec),
+          "src_%d"));
+  gst_object_unref (pad);
+  g_free (name);
+  gst_pad_set_active (stream->srcpad, TRUE);
+  gst_element_add_pad (GST_ELEMENT (tsdec), stream->srcpad);
+
+  tsdec->pid_streams[pid] = stream;
+  tsdec->streams = g_list_append (tsdec->streams, stream);
+
+  return stream;
+}
+
+static void
+gst_teletexttsdec_free_stream (GstTeletextTsDec * tsdec,
+    GstTeletextTsDecStream * stream)
+{
+  GstMiniObject *obj;
+  GstPad *pad;
+
+  while ((obj = g_queue_pop_head (&stream->pending)) != NULL)
+    gst_mini_object_unref (obj);
+  g_byte_array_free (stream->collect, TRUE);
+
+  gst_pad_set_active (stream->srcpad, FALSE);
+  gst_element_remove_pad (GST_ELEMENT (tsdec), stream->srcpad);
+
+  gst_pad_set_active (stream->feedpad, FALSE);
+  pad = gst_element_get_static_pad (stream->decoder, "sink");
+  gst_pad_unlink (stream->feedpad, pad);
+  gst_object_unref (pad);
+  gst_object_unref (stream->feedpad);
+
+  gst_element_set_state (stream->decoder, GST_STATE_NULL);
+  gst_bin_remove (GST_BIN (tsdec), stream->decoder);
+
+  g_free (stream);
+}
+
+static void
+gst_teletexttsdec_clear (GstTeletextTsDec * tsdec)
+{
+  GList *l;
+  gint i;
+
+  for (l = tsdec->streams; l != NULL; l = l->next)
+    gst_teletexttsdec_free_stream (tsdec,
+        (GstTeletextTsDecStream *) l->data);
+  g_list_free (tsdec->streams);
+  tsdec->streams = NULL;
+
+  for (i = 0; i < GST_TELETEXTTSDEC_N_PIDS; i++) {
+    g_free (tsdec->sections[i]);
+    tsdec->sections[i] = NULL;
+    tsdec->pid_streams[i] = NULL;
+  }
+  /* The PAT is always watched, PMT sections are added as it is parsed */
+  tsdec->sections[PAT_PID] = g_new0 (GstTeletextTsDecSection, 1);
+  tsdec->sections[PAT_PID]->version = -1;
+
+  tsdec->residue_size = 0;
+  tsdec->n_pmts = 0;
+  tsdec->n_pmts_parsed = 0;
+  tsdec->pads_complete = FALSE;
+  gst_segment_init (&tsdec->segment, GST_FORMAT_UNDEFINED);
+  tsdec->in_timestamp = GST_CLOCK_TIME_NONE;
+  tsdec->base_pts = -1;
+  tsdec->base_time = 0;
+}
+
+static void
+gst_teletexttsdec_parse_pat (GstTeletextTsDec * tsdec, const guint8 * data,
+    guint size)
+{
+  guint i;
+
+  /* program loop up to the CRC */
+  for (i = 8; i + 4 + 4 <= size; i += 4) {
+    guint16 program = GST_READ_UINT16_BE (data + i);
+    guint16 pid = GST_READ_UINT16_BE (data + i + 2) & 0x1FFF;
+
+    /* program 0 points to the NIT */
+    if (program == 0 || tsdec->sections[pid] != NULL)
+      continue;
+
+    GST_DEBUG_OBJECT (tsdec, "Program %u has its PMT on PID %u", program, pid);
+    tsdec->sections[pid] = g_new0 (GstTeletextTsDecSection, 1);
+    tsdec->sections[pid]->version = -1;
+    tsdec->n_pmts++;
+  }
+}
+
+static void
+gst_teletexttsdec_parse_pmt (GstTeletextTsDec * tsdec, const guint8 * data,
+    guint size)
+{
+  guint i, end = size - 4;
+
+  if (size < 12 + 4)
+    return;
+
+  /* skip the program info descriptors */
+  i = 12 + (GST_READ_UINT16_BE (data + 10) & 0x0FFF);
+
+  while (i + 5 <= end) {
+    guint8 stream_type = data[i];
+    guint16 pid = GST_READ_UINT16_BE (data + i + 1) & 0x1FFF;
+    guint es_info_end = i + 5 + (GST_READ_UINT16_BE (data + i + 3) & 0x0FFF);
+    guint j;
+
+    if (es_info_end > end)
+      break;
+
+    if (stream_type == STREAM_TYPE_PRIVATE_PES &&
+        tsdec->pid_streams[pid] == NULL) {
+      for (j = i + 5; j + 2 <= es_info_end; j += 2 + data[j + 1]) {
+        if (data[j] == DESCRIPTOR_TELETEXT) {
+          gst_teletexttsdec_add_stream (tsdec, pid);
+          break;
+        }
+      }
+    }
+
+    i = es_info_end;
+  }
+}
+
+/* Adds the payload of a packet of a PSI PID and parses the section once it
+ * is complete. Only the first section starting in a packet is parsed, which
+ * is all the PAT and PMTs use in practice. */
+static void
+gst_teletexttsdec_feed_section (GstTeletextTsDec * tsdec, guint16 pid,
+    const guint8 * payload, guint size, gboolean unit_start)
+{
+  GstTeletextTsDecSection *section = tsdec->sections[pid];
+  guint length, version;
+
+  if (unit_start) {
+    guint pointer = payload[0];
+
+    if (1 + pointer >= size)
+      return;
+    payload += 1 + pointer;
+    size -= 1 + pointer;
+    section->size = 0;
+  } else if (section->size == 0) {
+    /* wait for the start of a section */
+    return;
+  }
+
+  size = MIN (size, GST_TELETEXTTSDEC_MAX_SECTION_SIZE - section->size);
+  memcpy (section->data + section->size, payload, size);
+  section->size += size;
+
+  if (section->size < 8)
+    return;
+  length = 3 + (GST_READ_UINT16_BE (section->data + 1) & 0x0FFF);
+  if (length > GST_TELETEXTTSDEC_MAX_SECTION_SIZE) {
+    section->size = 0;
+    return;
+  }
+  if (section->size < length)
+    return;
+  section->size = 0;
+
+  /* only parse new versions of the current table */
+  if (!(section->data[5] & 0x01))
+    return;
+  version = (section->data[5] >> 1) & 0x1F;
+  if ((gint) version == section->version)
+    return;
+
+  if (pid == PAT_PID && section->data[0] == TABLE_ID_PAT) {
+    gst_teletexttsdec_parse_pat (tsdec, section->data, length);
+  } else if (pid != PAT_PID && section->data[0] == TABLE_ID_PMT) {
+    gst_teletexttsdec_parse_pmt (tsdec, section->data, length);
+    if (section->version == -1)
+      tsdec->n_pmts_parsed++;
+  } else {
+    return;
+  }
+  section->version = version;
+
+  /* every program announced so far has been looked at */
+  if (!tsdec->pads_complete && tsdec->n_pmts > 0 &&
+      tsdec->n_pmts_parsed == tsdec->n_pmts) {
+    GST_DEBUG_OBJECT (tsdec, "Found %u teletext streams in %u programs",
+        g_list_length (tsdec->streams), tsdec->n_pmts);
+    tsdec->pads_complete = TRUE;
+    gst_element_no_more_pads (GST_ELEMENT (tsdec));
+  }
+}
+
+/* Adds the payload of a packet of @stream to the PES packet being
+ * reassembled, and hands the packet on once complete. Teletext PES packets
+ * have their length set, others end where the next one starts. */
+static void
+gst_teletexttsdec_collect_pes (GstTeletextTsDec * tsdec,
+    GstTeletextTsDecStream * stream, const guint8 * payload, guint size,
+    gboolean unit_start)
+{
+  GByteArray *collect = stream->collect;
+  guint length;
+
+  if (unit_start) {
+    if (collect->len > 0)
+      gst_teletexttsdec_push_pes (tsdec, stream, collect->len);
+  } else if (collect->len == 0) {
+    /* wait for the start of a PES packet */
+    return;
+  }
+
+  g_byte_array_append (collect, payload, size);
+  if (collect->len < PES_HEADER_SIZE)
+    return;
+
+  length = GST_READ_UINT16_BE (collect->data + 4);
+  if (length > 0 && collect->len >= PES_HEADER_SIZE + length)
+    gst_teletexttsdec_push_pes (tsdec, stream, PES_HEADER_SIZE + length);
+}
+
+static void
+gst_teletexttsdec_parse_packet (GstTeletextTsDec * tsdec, const guint8 * data)
+{
+  GstTeletextTsDecStream *stream;
+  guint16 pid;
+  guint offset = 4;
+  gboolean unit_start;
+
+  /* transport error indicator */
+  if (data[1] & 0x80)
+    return;
+
+  pid = GST_READ_UINT16_BE (data + 1) & 0x1FFF;
+  unit_start = (data[1] & 0x40) != 0;
+
+  /* scrambled or without payload */
+  if ((data[3] & 0xC0) || !(data[3] & 0x10))
+    return;
+  if (data[3] & 0x20)
+    offset += 1 + data[4];
+  if (offset >= PACKET_SIZE)
+    return;
+
+  stream = tsdec->pid_streams[pid];
+  if (stream != NULL) {
+    gst_teletexttsdec_collect_pes (tsdec, stream, data + offset,
+        PACKET_SIZE - offset, unit_start);
+  } else if (tsdec->sections[pid] != NULL) {
+    gst_teletexttsdec_feed_section (tsdec, pid, data + offset,
+        PACKET_SIZE - offset, unit_start);
+  }
+}
+
+static GstFlowReturn
+gst_teletexttsdec_chain (GstPad * pad, GstBuffer * buf)
+{
+  GstTeletextTsDec *tsdec = GST_TELETEXTTSDEC (GST_PAD_PARENT (pad));
+  GstFlowReturn ret = GST_FLOW_OK;
+  const guint8 *data = GST_BUFFER_DATA (buf);
+  guint size = GST_BUFFER_SIZE (buf);
+  gboolean linked = FALSE;
+  GList *l;
+
+  tsdec->in_timestamp = GST_BUFFER_TIMESTAMP (buf);
+
+  /* complete the packet left over from the last buffer */
+  if (tsdec->residue_size > 0) {
+    guint needed = PACKET_SIZE - tsdec->residue_size;
+
+    if (size < needed) {
+      memcpy (tsdec->residue + tsdec->residue_size, data, size);
+      tsdec->residue_size += size;
+      goto done;
+    }
+    memcpy (tsdec->residue + tsdec->residue_size, data, needed);
+    gst_teletexttsdec_parse_packet (tsdec, tsdec->residue);
+    tsdec->residue_size = 0;
+    data += needed;
+    size -= needed;
+  }
+
+  while (size >= PACKET_SIZE) {
+    if (G_UNLIKELY (data[0] != SYNC_BYTE)) {
+      const guint8 *sync = memchr (data + 1, SYNC_BYTE, size - 1);
+
+      GST_DEBUG_OBJECT (tsdec, "Lost sync");
+      if (sync == NULL) {
+        size = 0;
+        break;
+      }
+      size -= sync - data;
+      data = sync;
+      continue;
+    }
+
+    gst_teletexttsdec_parse_packet (tsdec, data);
+    data += PACKET_SIZE;
+    size -= PACKET_SIZE;
+  }
+
+  if (size > 0) {
+    memcpy (tsdec->residue, data, size);
+    tsdec->residue_size = size;
+  }
+
+  /* an unlinked stream is fine as long as another one is linked */
+  g_mutex_lock (tsdec->lock);
+  for (l = tsdec->streams; l != NULL; l = l->next) {
+    GstFlowReturn last_ret = ((GstTeletextTsDecStream *) l->data)->last_ret;
+
+    if (last_ret == GST_FLOW_NOT_LINKED)
+      continue;
+    linked = TRUE;
+    if (last_ret != GST_FLOW_OK) {
+      ret = last_ret;
+      break;
+    }
+  }
+  g_mutex_unlock (tsdec->lock);
+  if (!linked && tsdec->pads_complete && tsdec->streams != NULL)
+    ret = GST_FLOW_NOT_LINKED;
+
+done:
+  gst_buffer_unref (buf);
+
+  return ret;
+}
@@ -0,0 +1,128 @@
+/*
+ * GStreamer
+ * Copyright (C) 2009 Sebastian <sebp@k-d-w.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __GST_TELETEXTTSDEC_H__
+#define __GST_TELETEXTTSDEC_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+#define GST_TYPE_TELETEXTTSDEC \
+  (gst_teletexttsdec_get_type())
+#define GST_TELETEXTTSDEC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_TELETEXTTSDEC,GstTeletextTsDec))
+#define GST_TELETEXTTSDEC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_TELETEXTTSDEC,GstTeletextTsDecClass))
+#define GST_IS_TELETEXTTSDEC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_TELETEXTTSDEC))
+#define GST_IS_TELETEXTTSDEC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_TELETEXTTSDEC))
+#define GST_TELETEXTTSDEC_N_PIDS 8192
+#define GST_TELETEXTTSDEC_PACKET_SIZE 188
+#define GST_TELETEXTTSDEC_MAX_SECTION_SIZE 1024
+typedef struct _GstTeletextTsDec GstTeletextTsDec;
+typedef struct _GstTeletextTsDecClass GstTeletextTsDecClass;
+typedef struct _GstTeletextTsDecStream GstTeletextTsDecStream;
+typedef struct _GstTeletextTsDecSection GstTeletextTsDecSection;
+
+/* PSI section being reassembled from the packets of a PID */
+struct _GstTeletextTsDecSection
+{
+  guint8 data[GST_TELETEXTTSDEC_MAX_SECTION_SIZE];
+  guint size;
+  /* version of the last section parsed, -1 before the first */
+  gint version;
+};
+
+/* One teletext PID, decoded by a teletextdec in the bin */
+struct _GstTeletextTsDecStream
+{
+  GstTeletextTsDec *tsdec;
+  guint16 pid;
+  GstElement *decoder;
+  /* pushes the PES packets of the PID to the decoder */
+  GstPad *feedpad;
+  /* ghost pad of the src pad of the decoder */
+  GstPad *srcpad;
+  gboolean need_segment;
+
+  /* PES packet being reassembled from the packet payloads */
+  GByteArray *collect;
+  /* last PTS of the PID, unwrapped, -1 before the first */
+  gint64 last_pts;
+
+  /* PES packets and events handed to the pool */
+  GQueue pending;
+  gboolean scheduled;
+
+  /* protected by the lock of the tsdec */
+  GstFlowReturn last_ret;
+};
+
+struct _GstTeletextTsDec
+{
+  GstBin bin;
+
+  GstPad *sinkpad;
+
+  /* Props */
+  gint pageno;
+  gint subno;
+  gboolean subtitles_mode;
+  guint threads;
+
+  /* Start of a packet split across input buffers */
+  guint8 residue[GST_TELETEXTTSDEC_PACKET_SIZE];
+  guint residue_size;
+
+  /* Indexed by PID: sections of the PAT and PMTs, and teletext streams */
+  GstTeletextTsDecSection **sections;
+  GstTeletextTsDecStream **pid_streams;
+  GList *streams;
+  guint n_pmts;
+  guint n_pmts_parsed;
+  gboolean pads_complete;
+
+  /* Upstream segment, converted to time for the decoders */
+  GstSegment segment;
+  GstClockTime in_timestamp;
+
+  /* First PTS after the segment, unwrapped, which is output at base_time.
+   * -1 until the first. */
+  gint64 base_pts;
+  GstClockTime base_time;
+
+  /* The streams are decoded on this pool when threads is set. What is
+   * queued on a stream is only pushed by one worker at a time. */
+  GThreadPool *pool;
+  GMutex *lock;
+  GCond *cond;
+  guint n_pending;
+};
+
+struct _GstTeletextTsDecClass
+{
+  GstBinClass parent_class;
+};
+
+GType gst_teletexttsdec_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_TELETEXTTSDEC_H__ */
@@ -24,6 +24,8 @@
 
 #include <gst/gst.h>
 #include "gstteletextdec.h"
+#include "gstteletextsrc.h"
+#include "gstteletexttsdec.h"
 
 /* entry point to initialize the plug-in
  * initialize the plug-in itself
@@ -40,8 +42,16 @@ teletext_init (GstPlugin * teletext)
       vbi_log_on_stderr,
       /* user_data */ NULL);
 
-  return gst_element_register (teletext, "teletextdec", GST_RANK_NONE,
-      GST_TYPE_TELETEXTDEC);
+  if (!gst_element_register (teletext, "teletextdec", GST_RANK_NONE,
+          GST_TYPE_TELETEXTDEC))
+    return FALSE;
+
+  if (!gst_element_register (teletext, "teletextsrc", GST_RANK_NONE,
+          GST_TYPE_TELETEXTSRC))
+    return FALSE;
+
+  return gst_element_register (teletext, "teletexttsdec", GST_RANK_NONE,
+      GST_TYPE_TELETEXTTSDEC);
 }
 
 GST_PLUGIN_DEFINE (